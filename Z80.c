@@ -64,14 +64,109 @@ typedef zuint8 (* Instruction)(Z80 *object);
 #define ROR(value) value = (zuint8)Z_8BIT_ROTATE_RIGHT(value, 1)
 
 
-/* MARK: - Macros & Functions: Callback */
+/* MARK: - Macros & Functions: Callback
+
+   Optional. When the file that includes Z80.c defines CPU_Z80_BUS_READ,
+   CPU_Z80_BUS_WRITE, CPU_Z80_BUS_IN or CPU_Z80_BUS_OUT (with the same
+   parameters as the callbacks), they are used instead of the corresponding
+   callback, so the compiler can inline the bus of the machine into the
+   instruction handlers. The callbacks they replace are never called. */
+
+#ifdef CPU_Z80_BUS_READ
+#	define BUS_READ(address) CPU_Z80_BUS_READ(object->context, address)
+#else
+#	define BUS_READ(address) object->read(object->context, address)
+#endif
+
+#ifdef CPU_Z80_BUS_WRITE
+#	define BUS_WRITE(address, value) CPU_Z80_BUS_WRITE(object->context, address, value)
+#else
+#	define BUS_WRITE(address, value) object->write(object->context, address, value)
+#endif
+
+#ifdef CPU_Z80_BUS_IN
+#	define BUS_IN(port) CPU_Z80_BUS_IN(object->context, port)
+#else
+#	define BUS_IN(port) object->in(object->context, port)
+#endif
+
+#ifdef CPU_Z80_BUS_OUT
+#	define BUS_OUT(port, value) CPU_Z80_BUS_OUT(object->context, port, value)
+#else
+#	define BUS_OUT(port, value) object->out(object->context, port, value)
+#endif
+
+#if	defined(CPU_Z80_WITH_MEMORY_MAP	 ) || \
+	defined(CPU_Z80_WITH_IDLE_LOOPS	 )
+
+	static Z_INLINE zuint8 read_8bit(Z80 *object, zuint16 address)
+		{
+#		ifdef CPU_Z80_WITH_MEMORY_MAP
+			zuint8 const *page = object->read_map[address >> 8];
+
+			return page != NULL
+				? page[address & 0xFF]
+				: BUS_READ(address);
+#		else
+			return BUS_READ(address);
+#		endif
+		}
+
+
+	static Z_INLINE void write_8bit(Z80 *object, zuint16 address, zuint8 value)
+		{
+#		ifdef CPU_Z80_WITH_MEMORY_MAP
+			zuint8 *page;
+#		endif
+
+#		ifdef CPU_Z80_WITH_IDLE_LOOPS
+			object->idle_clean = FALSE;
+#		endif
+
+#		ifdef CPU_Z80_WITH_MEMORY_MAP
+			if ((page = object->write_map[address >> 8]) != NULL) page[address & 0xFF] = value;
+			else BUS_WRITE(address, value);
+#		else
+			BUS_WRITE(address, value);
+#		endif
+		}
+
+
+#	define READ_8(address)	       read_8bit (object, (zuint16)(address))
+#	define WRITE_8(address, value) write_8bit(object, (zuint16)(address), (zuint8)(value))
+
+#else
+#	define READ_8(address)	       BUS_READ ((zuint16)(address))
+#	define WRITE_8(address, value) BUS_WRITE((zuint16)(address), (zuint8)(value))
+#endif
+
+#ifdef CPU_Z80_WITH_IDLE_LOOPS
+
+	static Z_INLINE zuint8 in_8bit(Z80 *object, zuint16 port)
+		{
+		if (!(object->idempotent_ports[(port & 0xFF) >> 3] & (1 << (port & 7))))
+			object->idle_clean = FALSE;
+
+		return BUS_IN(port);
+		}
+
+
+	static Z_INLINE void out_8bit(Z80 *object, zuint16 port, zuint8 value)
+		{
+		object->idle_clean = FALSE;
+		BUS_OUT(port, value);
+		}
+
+
+#	define IN(port)		in_8bit (object, (zuint16)(port))
+#	define OUT(port, value) out_8bit(object, (zuint16)(port), (zuint8)(value))
+
+#else
+#	define IN(port)		BUS_IN ((zuint16)(port))
+#	define OUT(port, value) BUS_OUT((zuint16)(port), (zuint8)(value))
+#endif
 
-#define READ_8(address)		object->read	(object->context, (zuint16)(address))
-#define WRITE_8(address, value) object->write	(object->context, (zuint16)(address), (zuint8)(value))
-#define IN(port)		object->in	(object->context, (zuint16)(port   ))
-#define OUT(port, value)	object->out	(object->context, (zuint16)(port   ), (zuint8)(value))
 #define INT_DATA		object->int_data(object->context)
-#define READ_OFFSET(address)	((zsint8)READ_8(address))
 #define SET_HALT		if (object->halt != NULL) object->halt(object->context, TRUE )
 #define CLEAR_HALT		if (object->halt != NULL) object->halt(object->context, FALSE)
 
@@ -90,10 +185,47 @@ static Z_INLINE void write_16bit(Z80 *object, zuint16 address, zuint16 value)
 #define READ_16(address)	 read_16bit (object, (zuint16)(address))
 #define WRITE_16(address, value) write_16bit(object, (zuint16)(address), (zuint16)(value))
 
+/*----------------------------------------------------------------------.
+| The reads of the bytes of the instruction being executed are marked,	|
+| so that z80_trace and the host can tell them from data reads.		|
+'----------------------------------------------------------------------*/
+#if defined(CPU_Z80_WITH_TRACE) || defined(CPU_Z80_WITH_COVERAGE)
+
+	static Z_INLINE zuint8 code_8bit(Z80 *object, zuint16 address)
+		{
+		zuint8 value;
+
+		object->fetching = TRUE;
+		value = READ_8(address);
+		object->fetching = FALSE;
+		return value;
+		}
+
+
+	static Z_INLINE zuint16 code_16bit(Z80 *object, zuint16 address)
+		{
+		zuint16 value;
+
+		object->fetching = TRUE;
+		value = READ_16(address);
+		object->fetching = FALSE;
+		return value;
+		}
+
+
+#	define CODE_8(address)  code_8bit (object, (zuint16)(address))
+#	define CODE_16(address) code_16bit(object, (zuint16)(address))
+
+#else
+#	define CODE_8(address)  READ_8 (address)
+#	define CODE_16(address) READ_16(address)
+#endif
+
+#define CODE_OFFSET(address) ((zsint8)CODE_8(address))
+
 
 /* MARK: - Macros: Registers */
 
-#define AF    object->state.Z_Z80_STATE_MEMBER_AF
 #define BC    object->state.Z_Z80_STATE_MEMBER_BC
 #define DE    object->state.Z_Z80_STATE_MEMBER_DE
 #define HL    object->state.Z_Z80_STATE_MEMBER_HL
@@ -106,7 +238,6 @@ static Z_INLINE void write_16bit(Z80 *object, zuint16 address, zuint16 value)
 #define DE_   object->state.Z_Z80_STATE_MEMBER_DE_
 #define HL_   object->state.Z_Z80_STATE_MEMBER_HL_
 #define A     object->state.Z_Z80_STATE_MEMBER_A
-#define F     object->state.Z_Z80_STATE_MEMBER_F
 #define B     object->state.Z_Z80_STATE_MEMBER_B
 #define C     object->state.Z_Z80_STATE_MEMBER_C
 #define L     object->state.Z_Z80_STATE_MEMBER_L
@@ -114,6 +245,22 @@ static Z_INLINE void write_16bit(Z80 *object, zuint16 address, zuint16 value)
 #define R     object->state.Z_Z80_STATE_MEMBER_R
 #define R_ALL ((R & 127) | (R7 & 128))
 
+#ifdef CPU_Z80_WITH_LAZY_FLAGS
+
+	/*-----------------------------------------------------------------.
+	| F (and AF, which contains it) are computed on access if the last |
+	| 8-bit arithmetic or logical instruction left them pending.	   |
+	'-----------------------------------------------------------------*/
+	static Z_INLINE Z80 *flags(Z80 *object);
+
+#	define AF (*Z_BOP(zuint16 *, flags(object), O(state.Z_Z80_STATE_MEMBER_AF)))
+#	define F  (*Z_BOP(zuint8  *, flags(object), O(state.Z_Z80_STATE_MEMBER_F )))
+
+#else
+#	define AF object->state.Z_Z80_STATE_MEMBER_AF
+#	define F  object->state.Z_Z80_STATE_MEMBER_F
+#endif
+
 
 /* MARK: - Macros: Internal Bits */
 
@@ -129,6 +276,7 @@ static Z_INLINE void write_16bit(Z80 *object, zuint16 address, zuint16 value)
 /* MARK: - Macros: Temporal Data */
 
 #define CYCLES	    object->cycles
+#define CYCLE_LIMIT object->cycle_limit
 #define R7	    object->r7
 #define BYTE(index) object->data.array_uint8[index]
 #define BYTE0	    BYTE(0)
@@ -138,6 +286,229 @@ static Z_INLINE void write_16bit(Z80 *object, zuint16 address, zuint16 value)
 #define XY	    object->xy.value_uint16
 #define XY_ADDRESS  ((zuint16)(XY + object->data.array_sint8[2]))
 
+/* The repeat instructions also add cycles to CYCLES by themselves, so the
+   cycles returned by an instruction must be read before updating it. */
+#define ADD_CYCLES(instruction)				\
+	{						\
+	zuint8 instruction_cycles = instruction;	\
+							\
+	CYCLES += instruction_cycles;			\
+	COUNT_INSTRUCTION(instruction_cycles)		\
+	TRACE_INSTRUCTION				\
+	}
+
+
+/* MARK: - Histogram */
+
+#ifdef CPU_Z80_WITH_HISTOGRAM
+
+	/* The instruction is classified by the opcode bytes that the
+	   selectors left in the temporary data. */
+	static void histogram_count(Z80 *object, zusize count, zusize cycles)
+		{
+		zuint8 table  = Z80_HISTOGRAM_TABLE;
+		zuint8 opcode = BYTE0;
+
+		switch (opcode)
+			{
+			case 0xCB: table = Z80_HISTOGRAM_TABLE_CB; opcode = BYTE1; break;
+			case 0xED: table = Z80_HISTOGRAM_TABLE_ED; opcode = BYTE1; break;
+
+			case 0xDD: case 0xFD:
+			if (BYTE1 == 0xCB) {table = Z80_HISTOGRAM_TABLE_XY_CB; opcode = BYTE3;}
+			else		   {table = Z80_HISTOGRAM_TABLE_XY;    opcode = BYTE1;}
+			}
+
+		object->histogram->count [table][opcode] += count;
+		object->histogram->cycles[table][opcode] += cycles;
+		}
+
+
+#	define COUNTING (object->histogram != NULL)
+
+#	define COUNT_INSTRUCTION(cycles) \
+		if (object->histogram != NULL) histogram_count(object, 1, cycles);
+
+#	define COUNT_INSTRUCTIONS(count, cycles) \
+		if (object->histogram != NULL) histogram_count(object, count, cycles);
+
+#	define COUNT_INTERRUPT(counter, cycles)			       \
+		if (object->histogram != NULL)			       \
+			{					       \
+			object->histogram->counter++;		       \
+			object->histogram->interrupt_cycles += cycles; \
+			}
+
+#else
+#	define COUNTING FALSE
+#	define COUNT_INSTRUCTION(cycles)
+#	define COUNT_INSTRUCTIONS(count, cycles)
+#	define COUNT_INTERRUPT(counter, cycles)
+#endif
+
+
+/* MARK: - Call Hooks */
+
+#ifdef CPU_Z80_WITH_CALL_HOOKS
+
+#	define HOOK_CALL(kind) \
+		if (object->call != NULL) object->call(object->context, PC, kind);
+
+#	define HOOK_RET \
+		if (object->ret != NULL) object->ret(object->context);
+
+#	define HOOK_SP_LOAD \
+		if (object->sp_load != NULL) object->sp_load(object->context);
+
+	/* ld SS,... loads SP when the SS field of the opcode is 3. */
+#	define SP_LOADED(opcode) \
+		if ((opcode & 0x30) == 0x30) {HOOK_SP_LOAD}
+
+#else
+#	define HOOK_CALL(kind)
+#	define HOOK_RET
+#	define HOOK_SP_LOAD
+#	define SP_LOADED(opcode)
+#endif
+
+
+/* MARK: - Trace
+
+   Optional. The start of every instruction is noted, and once it has run
+   its record is written with the opcode bytes that the selectors left in
+   the temporary data, followed by a record for each register it changed
+   if requested. The records of the accesses that the bus callbacks add
+   meanwhile are therefore written before it. */
+
+#ifdef CPU_Z80_WITH_TRACE
+
+	static Z80TraceRecord *trace_record(Z80 *object, zuint8 type, zuint16 address, zuint64 cycle)
+		{
+		Z80TraceRecord *record;
+
+		if (object->trace == object->trace_end)
+			{
+			object->trace_full(object->trace_context);
+			if (object->trace == NULL) return NULL;
+			}
+
+		record = object->trace++;
+		record->cycle	= cycle;
+		record->address = address;
+		record->type	= type;
+		record->size	= 0;
+		record->data[0] = record->data[1] = record->data[2] = record->data[3] = 0;
+		return record;
+		}
+
+
+	static void trace_registers(Z80 *object, zuint64 cycle)
+		{
+		zuint16 values[Z80_TRACE_REGISTERS] = {AF, BC, DE, HL, IX, IY, SP, AF_, BC_, DE_, HL_};
+		Z80TraceRecord *record;
+		zuint8 index;
+
+		for (index = 0; index < Z80_TRACE_REGISTERS; index++)
+			if (values[index] != object->trace_values[index])
+				{
+				if ((record = trace_record(object, Z80_TRACE_REGISTER, index, cycle)) == NULL) return;
+				record->size	= 2;
+				record->data[0] = (zuint8)values[index];
+				record->data[1] = (zuint8)(values[index] >> 8);
+				object->trace_values[index] = values[index];
+				}
+		}
+
+
+	static void trace_instruction(Z80 *object)
+		{
+		zuint64 cycle = object->trace_clock + object->trace_start;
+		Z80TraceRecord *record;
+		zuint8 size = 1, index;
+
+		switch (BYTE0)
+			{
+			case 0xCB: case 0xED: size = 2; break;
+			case 0xDD: case 0xFD: size = BYTE1 == 0xCB ? 4 : 2;
+			}
+
+		if ((record = trace_record(object, Z80_TRACE_INSTRUCTION, object->trace_pc, cycle)) == NULL) return;
+		/* The operands fetched follow the opcodes. Some are not fetched,
+		   like the offset of a JR not taken. */
+		for (index = 0; index < size; index++) record->data[index] = BYTE(index);
+
+		for (; index < 4 && (object->trace_fetched_mask & (1U << index)); index++)
+			record->data[index] = object->trace_fetched[index];
+
+		record->size = index;
+		for (; index < 4; index++) record->data[index] = 0;
+		object->trace_fetched_mask = 0;
+
+		if (object->trace_registers) trace_registers(object, cycle);
+		}
+
+
+	/* The record of an interrupt is stamped when its handler starts. */
+	static void trace_interrupt(Z80 *object, zuint8 type, zuint8 mode)
+		{
+		Z80TraceRecord *record = trace_record(object, type, PC, object->trace_clock + CYCLES);
+
+		if (record == NULL) return;
+		record->size	= 1;
+		record->data[0] = mode;
+		}
+
+
+#	define TRACING (object->trace != NULL)
+
+#	define TRACE_START \
+		if (object->trace != NULL) {object->trace_pc = PC; object->trace_start = CYCLES;}
+
+#	define TRACE_INSTRUCTION \
+		if (object->trace != NULL) trace_instruction(object);
+
+#	define TRACE_INTERRUPT(type, mode) \
+		if (object->trace != NULL) trace_interrupt(object, type, mode);
+
+#else
+#	define TRACING FALSE
+#	define TRACE_START
+#	define TRACE_INSTRUCTION
+#	define TRACE_INTERRUPT(type, mode)
+#endif
+
+
+/* MARK: - Coverage
+
+   Optional. The address of every instruction is marked in the executed
+   bitmap before it runs. The bytes read as data are marked by the host
+   through z80_cover_read. */
+
+#ifdef CPU_Z80_WITH_COVERAGE
+
+#	define COVER \
+		if (object->coverage != NULL) object->coverage->executed[PC >> 3] |= 1 << (PC & 7);
+
+#else
+#	define COVER
+#endif
+
+
+/* MARK: - Breakpoints
+
+   Optional. While there are conditions to stop at (breakpoints, a number
+   of instructions or a check by the host), z80_run tests them before
+   accepting an interrupt or executing an instruction, so the paths that
+   run several instructions without returning to the loop are bypassed.
+   The conditions are bits of a single word, so without them the test is a
+   single branch. */
+
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+#	define BREAKING (object->stops)
+#else
+#	define BREAKING FALSE
+#endif
+
 
 /* MARK: - Macros: Flags */
 
@@ -305,7 +676,13 @@ static Z_INLINE zuint16 *name(Z80 *object) \
 
 R_16(__ss____0, s_table, 0)
 R_16(__ss____1, s_table, 1)
-R_16(__tt____ , t_table, 0)
+
+#ifdef CPU_Z80_WITH_LAZY_FLAGS
+	static Z_INLINE zuint16 *__tt____(Z80 *object)
+		{return Z_BOP(zuint16 *, flags(object), t_table[(BYTE0 & 48) >> 4]);}
+#else
+	R_16(__tt____ , t_table, 0)
+#endif
 
 
 /* MARK: - Condition Resolution
@@ -325,16 +702,22 @@ R_16(__tt____ , t_table, 0)
 
 static zuint8 const z_table[8] = {ZF, ZF, CF, CF, PF, PF, SF, SF};
 
-static Z_INLINE zboolean __zzz___(Z80 *object)
+static Z_INLINE zboolean condition(Z80 *object, zuint8 z)
 	{
-	zuint8 z = (BYTE0 & 56) >> 3;
-
 	return (F & (z_table[z]))
 		?  (z & 1)  /* Flag is 1 */
 		: !(z & 1); /* Flag is 0 */
 	}
 
 
+static Z_INLINE zboolean __zzz___(Z80 *object) {return condition(object, (BYTE0 & 56) >> 3);}
+
+
+/* The opcode is left as fetched, so that traces record it. */
+
+static Z_INLINE zboolean ___zz___(Z80 *object) {return condition(object, (BYTE0 & 24) >> 3);}
+
+
 /* MARK: - 8-Bit Arithmetic and Logical Operation Resolution and Execution
 
    .----------.   .-----------.		.-------------------------------.
@@ -361,114 +744,207 @@ static Z_INLINE zboolean __zzz___(Z80 *object)
 				  | dec | S | Z |v.5| H |v.3| V | 1 | . |
 				  '------------------------------------*/
 
-static void __uuu___(Z80 *object, zuint8 offset, zuint8 value)
-	{
-	zuint8 t;
+#ifdef CPU_Z80_WITH_FLAG_TABLES
 
-	switch ((object->data.array_uint8[offset] >> 3) & 7)
+	/* Optional. The flags of ADD, ADC, SUB, SBC and CP are looked up by
+	   carry, A and operand in two tables of 128 KiB, and those of AND, XOR,
+	   OR, INC and DEC in tables of 256 bytes, instead of being computed.
+	   flag-tables.c generates them with the code that they replace. */
+
+#	include "Z80-flag-tables.h"
+
+#	define FLAGS_INDEX(carry, a, value) ((zuint)(carry) << 16 | (zuint)(a) << 8 | (value))
+
+	static Z_INLINE zuint8 uuu_flags(zuint8 operation, zuint8 a, zuint8 value, zuint8 carry)
 		{
-		case 0:	/* ADD */
-		t = A + value;
+		switch (operation)
+			{
+			case 0: case 1: return add_flags_table[FLAGS_INDEX(carry, a, value)]; /* ADD, ADC */
+			case 2: case 3: return sub_flags_table[FLAGS_INDEX(carry, a, value)]; /* SUB, SBC */
+			case 4: return (zuint8)(logic_flags_table[a & value] | HF);	   /* AND	*/
+			case 5: return logic_flags_table[a ^ value];			   /* XOR	*/
+			case 6: return logic_flags_table[a | value];			   /* OR	*/
+
+			default: /* CP: YF = v.5, XF = v.3 */
+			return (zuint8)((sub_flags_table[FLAGS_INDEX(0, a, value)] & ~YXF) | (value & YXF));
+			}
+		}
 
-		F =	((zuint)A + value > 255)     /* CF = Carry	*/
-			| pf_overflow_add8(A, value) /* PF = Overflow	*/
-			| ((A ^ value ^ t) & HF);    /* HF = Half-carry */
-		A = t;				     /* NF = 0		*/
-		break;
+#else
 
-		case 1:	/* ADC */
-		t = F_C;
+	static zuint8 uuu_flags(zuint8 operation, zuint8 a, zuint8 value, zuint8 carry)
+		{
+		zuint8 t, f;
 
-		F =	((zuint)A + value + t > 255)		  /* CF = Carry	     */
-			| pf_overflow_adc8(A, value, t)		  /* PF = Overflow   */
-			| (((A & 0xF) + (value & 0xF) + t) & HF); /* HF = Half-carry */
-								  /* NF = 0	     */
-		A += value + t;
-		break;
+		switch (operation)
+			{
+			case 0:	/* ADD */
+			t = a + value;
+
+			f =	((zuint)a + value > 255)     /* CF = Carry	*/
+				| pf_overflow_add8(a, value) /* PF = Overflow	*/
+				| ((a ^ value ^ t) & HF);    /* HF = Half-carry */
+			break;				     /* NF = 0		*/
+
+			case 1:	/* ADC */
+			t = a + value + carry;
+
+			f =	((zuint)a + value + carry > 255)	      /* CF = Carry	 */
+				| pf_overflow_adc8(a, value, carry)	      /* PF = Overflow	 */
+				| (((a & 0xF) + (value & 0xF) + carry) & HF); /* HF = Half-carry */
+			break;						      /* NF = 0		 */
+
+			case 2:	/* SUB */
+			t = a - value;
+
+			f =	(a < value)		     /* CF = Borrow	 */
+				| NF			     /* NF = 1		 */
+				| pf_overflow_sub8(a, value) /* PF = Overflow	 */
+				| ((a ^ value ^ t) & HF);    /* HF = Half-Borrow */
+			break;
+
+			case 3: /* SBC */
+			t = a - value - carry;
+
+			f =	((zsint)a - (zsint)value - (zsint)carry < 0)  /* CF = Borrow	  */
+				| NF					      /* NF = 1		  */
+				| pf_overflow_sbc8(a, value, carry)	      /* PF = Overflow	  */
+				| (((a & 0xF) - (value & 0xF) - carry) & HF); /* HF = Half-Borrow */
+			break;
+
+			case 4: /* AND */
+			t = a & value;
+			f = HF | PF_PARITY(t); /* HF = 1; PF = Parity */
+			break;		       /* NF, CF = 0	      */
+
+			case 5: /* XOR */
+			t = a ^ value;
+			f = PF_PARITY(t); /* PF = Parity    */
+			break;		  /* HF, NF, CF = 0 */
+
+			case 6: /* OR */
+			t = a | value;
+			f = PF_PARITY(t); /* PF = Parity    */
+			break;		  /* HF, NF, CF = 0 */
+
+			default: /* CP */
+			t = a - value;
+
+			return (zuint8)
+				((a < value)		      /* CF = Borrow	    */
+				 | NF			      /* NF = 1		    */
+				 | pf_overflow_sub8(a, value) /* PF = Overflow	    */
+				 | ((a ^ value ^ t) & HF)     /* HF = Half-Borrow   */
+				 | (value & YXF)	      /* YF = v.5, XF = v.3 */
+				 | ZF_ZERO(t)		      /* ZF = !(A - v)	    */
+				 | (t & SF));		      /* SF = (A - v).7	    */
+			}
+
+		return (zuint8)
+			(f		 /* CF, NF, PF and HF already calculated */
+			 | (t & SYXF)	 /* SF = A.7; YF = A.5; XF = A.3	 */
+			 | ZF_ZERO(t));	 /* ZF = !A				 */
+		}
 
-		case 2:	/* SUB */
-		t = A - value;
+#endif
 
-		F =	(A < value)		     /* CF = Borrow	 */
-			| NF			     /* NF = 1		 */
-			| pf_overflow_sub8(A, value) /* PF = Overflow	 */
-			| ((A ^ value ^ t) & HF);    /* HF = Half-Borrow */
-		A = t;
-		break;
 
-		case 3: /* SBC */
-		t = F_C;
+static void __uuu___(Z80 *object, zuint8 offset, zuint8 value)
+	{
+	zuint8 operation = (object->data.array_uint8[offset] >> 3) & 7;
+	zuint8 carry = (operation & 5) == 1 ? F_C : 0; /* ADC and SBC */
+
+#	ifdef CPU_Z80_WITH_LAZY_FLAGS
+		object->flags_operation	  = operation + 1;
+		object->flags_operands[0] = A;
+		object->flags_operands[1] = value;
+		object->flags_operands[2] = carry;
+#	else
+		F = uuu_flags(operation, A, value, carry);
+#	endif
 
-		F =	((zsint)A - (zsint)value - (zsint)t < 0)  /* CF = Borrow      */
-			| NF					  /* NF = 1	      */
-			| pf_overflow_sbc8(A, value, t)		  /* PF = Overflow    */
-			| (((A & 0xF) - (value & 0xF) - t) & HF); /* HF = Half-Borrow */
+	switch (operation)
+		{
+		case 0: A += value;	    break; /* ADD */
+		case 1: A += value + carry; break; /* ADC */
+		case 2: A -= value;	    break; /* SUB */
+		case 3: A -= value + carry; break; /* SBC */
+		case 4: A &= value;	    break; /* AND */
+		case 5: A ^= value;	    break; /* XOR */
+		case 6: A |= value;	    break; /* OR  */
+		}
+	}
 
-		A -= value + t;
-		break;
 
-		case 4: /* AND */
-		A &= value;
-		F = HF | PF_PARITY(A); /* HF = 1; PF = Parity */
-		break;		       /* NF, CF = 0	      */
+#ifdef CPU_Z80_WITH_LAZY_FLAGS
 
-		case 5: /* XOR */
-		A ^= value;
-		F = PF_PARITY(A); /* PF = Parity    */
-		break;		  /* HF, NF, CF = 0 */
+	static void flags_compute(Z80 *object)
+		{
+		object->state.Z_Z80_STATE_MEMBER_F = uuu_flags(
+			object->flags_operation - 1,
+			object->flags_operands[0],
+			object->flags_operands[1],
+			object->flags_operands[2]);
 
-		case 6: /* OR */
-		A |= value;
-		F = PF_PARITY(A); /* PF = Parity    */
-		break;		  /* HF, NF, CF = 0 */
+		object->flags_operation = 0;
+		}
 
-		case 7: /* CP */
-		t = A - value;
 
-		F = (zuint8)
-			((A < value)		      /* CF = Borrow	    */
-			 | NF			      /* NF = 1		    */
-			 | pf_overflow_sub8(A, value) /* PF = Overflow	    */
-			 | ((A ^ value ^ t) & HF)     /* HF = Half-Borrow   */
-			 | (value & YXF)	      /* YF = v.5, XF = v.3 */
-			 | ZF_ZERO(t)		      /* ZF = !(A - v)	    */
-			 | (t & SF));		      /* SF = (A - v).7	    */
-		return;
+	static Z_INLINE Z80 *flags(Z80 *object)
+		{
+		if (object->flags_operation) flags_compute(object);
+		return object;
 		}
 
-	F = (zuint8)
-		((F & (HF | PF | NF | CF)) /* CF, NF, PF and HF already changed */
-		 | A_SYX		   /* SF = A.7; YF = A.5; XF = A.3	*/
-		 | ZF_ZERO(A));		   /* ZF = !A				*/
-	}
+#endif
 
 
-static zuint8 _____vvv(Z80 *object, zuint8 offset, zuint8 value)
-	{
-	zuint8 t, pn;
+#ifdef CPU_Z80_WITH_FLAG_TABLES
 
-	/* DEC */
-	if (object->data.array_uint8[offset] & 1)
-		{			      /* PF = Overflow */
-		pn = value == 128 ? PNF : NF; /* NF = 1        */
-		t = value - 1;
-		}
+	static zuint8 _____vvv(Z80 *object, zuint8 offset, zuint8 value)
+		{
+		/* DEC */
+		if (object->data.array_uint8[offset] & 1)
+			{
+			F = (zuint8)((F & CF) | dec_flags_table[value]); /* CF unchanged */
+			return value - 1;
+			}
 
-	/* INC */
-	else	{			    /* PF = Overflow */
-		pn = value == 127 ? PF : 0; /* NF = 0	     */
-		t = value + 1;
+		/* INC */
+		F = (zuint8)((F & CF) | inc_flags_table[value]); /* CF unchanged */
+		return value + 1;
 		}
 
-	F = (zuint8)
-		((F & CF)		  /* CF unchanged		  */
-		 | pn			  /* PF and NF already calculated */
-		 | (t & SYXF)		  /* SF = v.7; YF = v.5; XF = v.3 */
-		 | ((value ^ 1 ^ t) & HF) /* HF = Half-Borrow		  */
-		 | ZF_ZERO(t));		  /* ZF = !v			  */
+#else
 
-	return t;
-	}
+	static zuint8 _____vvv(Z80 *object, zuint8 offset, zuint8 value)
+		{
+		zuint8 t, pn;
+
+		/* DEC */
+		if (object->data.array_uint8[offset] & 1)
+			{			      /* PF = Overflow */
+			pn = value == 128 ? PNF : NF; /* NF = 1        */
+			t = value - 1;
+			}
+
+		/* INC */
+		else	{			    /* PF = Overflow */
+			pn = value == 127 ? PF : 0; /* NF = 0	     */
+			t = value + 1;
+			}
+
+		F = (zuint8)
+			((F & CF)		  /* CF unchanged		  */
+			 | pn			  /* PF and NF already calculated */
+			 | (t & SYXF)		  /* SF = v.7; YF = v.5; XF = v.3 */
+			 | ((value ^ 1 ^ t) & HF) /* HF = Half-Borrow		  */
+			 | ZF_ZERO(t));		  /* ZF = !v			  */
+
+		return t;
+		}
+
+#endif
 
 
 /* MARK: - Rotation and Shift Operation Resolution and Execution
@@ -604,6 +1080,7 @@ static Z_INLINE zuint8 _m______(Z80 *object, zuint8 offset, zuint8 value)
 #define SS1	  (*__ss____1(object))
 #define TT	  (*__tt____ (object))
 #define Z	    __zzz___ (object)
+#define ZZ	    ___zz___ (object)
 #define U0(value)   __uuu___ (object, 0, value)
 #define U1(value)   __uuu___ (object, 1, value)
 #define V0(value)   _____vvv (object, 0, value)
@@ -639,6 +1116,26 @@ static Z_INLINE zuint8 _m______(Z80 *object, zuint8 offset, zuint8 value)
 	register = t;
 
 
+/*---------------------------------------------------------------------.
+| Instead of rewinding PC and returning to z80_run after each iteration, |
+| the repeat instructions keep iterating as long as z80_run would run	 |
+| them again right away (cycles left, no interrupt to accept, no stop	 |
+| condition to check and no trace to record). The cycles of the		 |
+| previous iterations are added to CYCLES directly.			 |
+'---------------------------------------------------------------------*/
+#define REPEAT								    \
+	PC -= 2;							    \
+									    \
+	if (	CYCLES + 21 >= CYCLE_LIMIT || NMI || (INT && IFF1) ||	    \
+		BREAKING || TRACING					    \
+	)								    \
+		return 21;						    \
+									    \
+	CYCLES += 21;							    \
+	COUNT_INSTRUCTION(21)						    \
+	R += 2;
+
+
 #define LDX(operator)							   \
 	zuint8 n;							   \
 									   \
@@ -653,10 +1150,13 @@ static Z_INLINE zuint8 _m______(Z80 *object, zuint8 offset, zuint8 value)
 		 | (!!(--BC) << 2));  /* PF = 1 if BC != 0, else PF = 0 */
 
 
-#define LDXR(operator)	    \
-	LDX(operator)	    \
-	if (!BC) return 16; \
-	PC -= 2; return 21;
+#define LDXR(operator)		    \
+	for (;;)		    \
+		{		    \
+		LDX(operator)	    \
+		if (!BC) return 16; \
+		REPEAT		    \
+		}
 
 
 #define CPX(operator)						    \
@@ -676,10 +1176,13 @@ static Z_INLINE zuint8 _m______(Z80 *object, zuint8 offset, zuint8 value)
 		 | F_C);	       /* CF unchanged		 */
 
 
-#define CPXR(operator)		   \
-	CPX(operator)		   \
-	if (!BC || !n0) return 16; \
-	PC -= 2;	return 21;
+#define CPXR(operator)			   \
+	for (;;)			   \
+		{			   \
+		CPX(operator)		   \
+		if (!BC || !n0) return 16; \
+		REPEAT			   \
+		}
 
 
 static Z_INLINE void add_RR_NN(Z80 *object, zuint16 *r, zuint16 v)
@@ -786,10 +1289,13 @@ static Z_INLINE void add_RR_NN(Z80 *object, zuint16 *r, zuint16 v)
 	if (t > 255) F |= HCF;		  /* if (([HL] + ((C +/- 1) & 255)) > 255) HF = 1; else HF = 0 */
 
 
-#define INXR(hl_operator, c_operator) \
-	INX(hl_operator, c_operator); \
-	if (!B)	 return 16;	      \
-	PC -= 2; return 21;
+#define INXR(hl_operator, c_operator)	      \
+	for (;;)			      \
+		{			      \
+		INX(hl_operator, c_operator); \
+		if (!B) return 16;	      \
+		REPEAT			      \
+		}
 
 
 #define OUTX(operator)										     \
@@ -809,13 +1315,78 @@ static Z_INLINE void add_RR_NN(Z80 *object, zuint16 *r, zuint16 v)
 	if ((zuint)t + L > 255) F |= HCF;	/* if (L + [HL] > 255) CF = 1; else CF = 0	  */
 
 
-#define OTXR(operator)	    \
-	OUTX(operator);	    \
-	if (!B)	 return 16; \
-	PC -= 2; return 21;
+#define OTXR(operator)		   \
+	for (;;)		   \
+		{		   \
+		OUTX(operator);	   \
+		if (!B) return 16; \
+		REPEAT		   \
+		}
+
+
+#define RET PC = READ_16(SP); SP += 2; HOOK_RET
+
+
+/* MARK: - Idle Loop Detection
+
+   Optional. Every taken jump to the same or a lower address (the end of
+   a loop) compares the state of the CPU with the one it had the previous
+   time it arrived at that address. If they only differ in R, and in
+   between the CPU has not written to memory, performed output or read a
+   port with side effects, every following iteration will be identical
+   to the last one until something external changes. Those iterations
+   are skipped at once, as many as fit whole before the cycle limit. */
+
+#ifdef CPU_Z80_WITH_IDLE_LOOPS
+
+	static void idle_loop(Z80 *object, zuint8 cycles)
+		{
+		zuint8 *state = Z_BOP(zuint8 *, object, O(state));
+		zuint8 *saved = (zuint8 *)&object->idle_state;
+		zuint8 r = R;
+		zusize now = CYCLES + cycles;
+		zuint index;
+
+#		ifdef CPU_Z80_WITH_LAZY_FLAGS
+			flags(object);
+#		endif
+
+		if (object->idle_clean && PC == object->idle_state.Z_Z80_STATE_MEMBER_PC)
+			{
+			zuint8 refresh = r - object->idle_state.Z_Z80_STATE_MEMBER_R;
+
+			R = object->idle_state.Z_Z80_STATE_MEMBER_R;
+			for (index = 0; index < sizeof(ZZ80State) && state[index] == saved[index]; index++);
+			R = r;
+
+			if (index == sizeof(ZZ80State) && !NMI && !(INT && IFF1))
+				{
+				zusize period = now - object->idle_cycles;
+				zusize count = now < CYCLE_LIMIT ? (CYCLE_LIMIT - now) / period : 0;
+
+				if (count)
+					{
+					CYCLES += count * period;
+					R += (zuint8)(count * refresh);
+					now    += count * period;
+					if (object->idle != NULL) object->idle(object->context, PC, count * period);
+					}
+				}
+			}
+
+		for (index = 0; index < sizeof(ZZ80State); index++) saved[index] = state[index];
+		object->idle_cycles = now;
+		object->idle_clean  = TRUE;
+		}
+
 
+#	define IDLE_FROM	      zuint16 pc = PC;
+#	define IDLE_LOOP(cycles) if (PC <= pc && !BREAKING && !TRACING && !COUNTING) idle_loop(object, cycles);
 
-#define RET PC = READ_16(SP); SP += 2;
+#else
+#	define IDLE_FROM
+#	define IDLE_LOOP(cycles)
+#endif
 
 
 /* MARK: - Instructions: 8-Bit Load Group
@@ -852,20 +1423,20 @@ static Z_INLINE void add_RR_NN(Z80 *object, zuint16 *r, zuint16 v)
 
 INSTRUCTION(ld_X_Y)	       {PC++; X0 = Y0;						    return  4;}
 INSTRUCTION(ld_JP_KQ)	       {PC += 2; JP = KQ;					    return  8;}
-INSTRUCTION(ld_X_BYTE)	       {X0 = READ_8((PC += 2) - 1);				    return  7;}
-INSTRUCTION(ld_JP_BYTE)	       {JP = READ_8((PC += 3) - 1);				    return 11;}
+INSTRUCTION(ld_X_BYTE)	       {X0 = CODE_8((PC += 2) - 1);				    return  7;}
+INSTRUCTION(ld_JP_BYTE)	       {JP = CODE_8((PC += 3) - 1);				    return 11;}
 INSTRUCTION(ld_X_vhl)	       {PC++; X0 = READ_8(HL);					    return  7;}
-INSTRUCTION(ld_X_vXYOFFSET)    {X1 = READ_8(XY + READ_OFFSET((PC += 3) - 1));		    return 19;}
+INSTRUCTION(ld_X_vXYOFFSET)    {X1 = READ_8(XY + CODE_OFFSET((PC += 3) - 1));		    return 19;}
 INSTRUCTION(ld_vhl_Y)	       {PC++; WRITE_8(HL, Y0);					    return  7;}
-INSTRUCTION(ld_vXYOFFSET_Y)    {WRITE_8(XY + READ_OFFSET((PC += 3) - 1), Y1);		    return 19;}
-INSTRUCTION(ld_vhl_BYTE)       {WRITE_8(HL, READ_8((PC += 2) - 1));			    return 10;}
-INSTRUCTION(ld_vXYOFFSET_BYTE) {PC += 4; WRITE_8(XY + READ_OFFSET(PC - 2), READ_8(PC - 1)); return 19;}
+INSTRUCTION(ld_vXYOFFSET_Y)    {WRITE_8(XY + CODE_OFFSET((PC += 3) - 1), Y1);		    return 19;}
+INSTRUCTION(ld_vhl_BYTE)       {WRITE_8(HL, CODE_8((PC += 2) - 1));			    return 10;}
+INSTRUCTION(ld_vXYOFFSET_BYTE) {PC += 4; WRITE_8(XY + CODE_OFFSET(PC - 2), CODE_8(PC - 1)); return 19;}
 INSTRUCTION(ld_a_vbc)	       {PC++; A = READ_8(BC);					    return  7;}
 INSTRUCTION(ld_a_vde)	       {PC++; A = READ_8(DE);					    return  7;}
-INSTRUCTION(ld_a_vWORD)	       {A = READ_8(READ_16((PC += 3) - 2));			    return 13;}
+INSTRUCTION(ld_a_vWORD)	       {A = READ_8(CODE_16((PC += 3) - 2));			    return 13;}
 INSTRUCTION(ld_vbc_a)	       {PC++; WRITE_8(BC, A);					    return  7;}
 INSTRUCTION(ld_vde_a)	       {PC++; WRITE_8(DE, A);					    return  7;}
-INSTRUCTION(ld_vWORD_a)	       {WRITE_8(READ_16((PC += 3) - 2), A);			    return 13;}
+INSTRUCTION(ld_vWORD_a)	       {WRITE_8(CODE_16((PC += 3) - 2), A);			    return 13;}
 INSTRUCTION(ld_a_i)	       {PC += 2; A = I; LD_A_I_LD_A_R;				    return  9;}
 INSTRUCTION(ld_a_r)	       {PC += 2; A = R_ALL; LD_A_I_LD_A_R;			    return  9;}
 INSTRUCTION(ld_i_a)	       {PC += 2; I = A;						    return  9;}
@@ -899,16 +1470,16 @@ INSTRUCTION(ld_r_a)	       {PC += 2; R = R7 = A;					    return  9;}
 |  pop iy		<  FD  ><  E1  >		  ........  4 / 14  |
 '--------------------------------------------------------------------------*/
 
-INSTRUCTION(ld_SS_WORD)	 {SS0 = READ_16((PC += 3) - 2);		 return 10;}
-INSTRUCTION(ld_XY_WORD)	 {XY  = READ_16((PC += 4) - 2);		 return 14;}
-INSTRUCTION(ld_hl_vWORD) {HL  = READ_16(READ_16((PC += 3) - 2)); return 16;}
-INSTRUCTION(ld_SS_vWORD) {SS1 = READ_16(READ_16((PC += 4) - 2)); return 20;}
-INSTRUCTION(ld_XY_vWORD) {XY  = READ_16(READ_16((PC += 4) - 2)); return 20;}
-INSTRUCTION(ld_vWORD_hl) {WRITE_16(READ_16((PC += 3) - 2), HL);	 return 16;}
-INSTRUCTION(ld_vWORD_SS) {WRITE_16(READ_16((PC += 4) - 2), SS1); return 20;}
-INSTRUCTION(ld_vWORD_XY) {WRITE_16(READ_16((PC += 4) - 2), XY);	 return 20;}
-INSTRUCTION(ld_sp_hl)	 {PC++; SP = HL;			 return  6;}
-INSTRUCTION(ld_sp_XY)	 {PC += 2; SP = XY;			 return 10;}
+INSTRUCTION(ld_SS_WORD)	 {SS0 = CODE_16((PC += 3) - 2); SP_LOADED(BYTE0) return 10;}
+INSTRUCTION(ld_XY_WORD)	 {XY  = CODE_16((PC += 4) - 2);		 return 14;}
+INSTRUCTION(ld_hl_vWORD) {HL  = READ_16(CODE_16((PC += 3) - 2)); return 16;}
+INSTRUCTION(ld_SS_vWORD) {SS1 = READ_16(CODE_16((PC += 4) - 2)); SP_LOADED(BYTE1) return 20;}
+INSTRUCTION(ld_XY_vWORD) {XY  = READ_16(CODE_16((PC += 4) - 2)); return 20;}
+INSTRUCTION(ld_vWORD_hl) {WRITE_16(CODE_16((PC += 3) - 2), HL);	 return 16;}
+INSTRUCTION(ld_vWORD_SS) {WRITE_16(CODE_16((PC += 4) - 2), SS1); return 20;}
+INSTRUCTION(ld_vWORD_XY) {WRITE_16(CODE_16((PC += 4) - 2), XY);	 return 20;}
+INSTRUCTION(ld_sp_hl)	 {PC++; SP = HL; HOOK_SP_LOAD		 return  6;}
+INSTRUCTION(ld_sp_XY)	 {PC += 2; SP = XY; HOOK_SP_LOAD		 return 10;}
 INSTRUCTION(push_TT)	 {PC++; WRITE_16(SP -= 2, TT);		 return 11;}
 INSTRUCTION(push_XY)	 {PC += 2; WRITE_16(SP -= 2, XY);	 return 15;}
 INSTRUCTION(pop_TT)	 {PC++; TT = READ_16(SP); SP += 2;	 return 10;}
@@ -973,13 +1544,13 @@ INSTRUCTION(cpdr)      {CPXR(--)						       }
 
 INSTRUCTION(U_a_Y)	   {PC++; U0(Y0);					    return  4;}
 INSTRUCTION(U_a_KQ)	   {PC += 2; U1(KQ);					    return  8;}
-INSTRUCTION(U_a_BYTE)	   {U0(READ_8((PC += 2) - 1));				    return  7;}
+INSTRUCTION(U_a_BYTE)	   {U0(CODE_8((PC += 2) - 1));				    return  7;}
 INSTRUCTION(U_a_vhl)	   {PC++; U0(READ_8(HL));				    return  7;}
-INSTRUCTION(U_a_vXYOFFSET) {U1(READ_8(XY + READ_OFFSET((PC += 3) - 1)));	    return 19;}
+INSTRUCTION(U_a_vXYOFFSET) {U1(READ_8(XY + CODE_OFFSET((PC += 3) - 1)));	    return 19;}
 INSTRUCTION(V_X)	   {zuint8 *r; PC++;    r = __xxx___0(object); *r = V0(*r); return  4;}
 INSTRUCTION(V_JP)	   {zuint8 *r; PC += 2; r = __jjj___ (object); *r = V1(*r); return  8;}
 INSTRUCTION(V_vhl)	   {PC++; WRITE_8(HL, V0(READ_8(HL)));			    return 11;}
-INSTRUCTION(V_vXYOFFSET)   {zuint16 a = (zuint16)(XY + READ_OFFSET((PC += 3) - 1));
+INSTRUCTION(V_vXYOFFSET)   {zuint16 a = (zuint16)(XY + CODE_OFFSET((PC += 3) - 1));
 			    WRITE_8(a, V1(READ_8(a)));				    return 23;}
 
 
@@ -1015,7 +1586,6 @@ INSTRUCTION(V_vXYOFFSET)   {zuint16 a = (zuint16)(XY + READ_OFFSET((PC += 3) - 1
 '--------------------------------------------------------------------------*/
 
 INSTRUCTION(nop)  {PC++;			     return 4;}
-INSTRUCTION(halt) {HALT = 1; SET_HALT;		     return 4;}
 INSTRUCTION(di)	  {PC++; IFF1 = IFF2 = 0; EI = TRUE; return 4;}
 INSTRUCTION(ei)	  {PC++; IFF1 = IFF2 = 1; EI = TRUE; return 4;}
 INSTRUCTION(im_0) {PC += 2; IM = 0;		     return 8;}
@@ -1023,6 +1593,33 @@ INSTRUCTION(im_1) {PC += 2; IM = 1;		     return 8;}
 INSTRUCTION(im_2) {PC += 2; IM = 2;		     return 8;}
 
 
+/*--------------------------------------------------------------------.
+| z80_run executes HALT again every 4 cycles until an interrupt is     |
+| accepted. If none can be accepted before the cycle limit is reached, |
+| the remaining executions are skipped at once, consuming their cycles |
+| and memory refreshes, unless the stop conditions or the trace must   |
+| see each one.							       |
+'--------------------------------------------------------------------*/
+INSTRUCTION(halt)
+	{
+	zusize cycles = CYCLES + 4;
+
+	HALT = 1;
+	SET_HALT;
+
+	if (cycles < CYCLE_LIMIT && !NMI && !(INT && IFF1) && !BREAKING && !TRACING)
+		{
+		zusize count = (CYCLE_LIMIT - cycles + 3) / 4;
+
+		CYCLES += count * 4;
+		R += (zuint8)count;
+		COUNT_INSTRUCTIONS(count, count * 4)
+		}
+
+	return 4;
+	}
+
+
 INSTRUCTION(daa)
 	{
 	zuint8 t = (F_H || (A & 0xF ) > 9) ? 6 : 0;
@@ -1200,13 +1797,13 @@ INSTRUCTION(M_N_vXYOFFSET_Y) {zuint16 a = XY_ADDRESS; WRITE_8(a, Y3 = M3(READ_8(
 |  djnz OFFSET		<  10  ><OFFSET>		  ........  3,2 / 13,8	|
 '------------------------------------------------------------------------------*/
 
-INSTRUCTION(jp_WORD)	 {PC = READ_16(PC + 1);							return 10;}
-INSTRUCTION(jp_Z_WORD)	 {PC = Z ? READ_16(PC + 1) : PC + 3;					return 10;}
-INSTRUCTION(jr_OFFSET)	 {PC += (2 + READ_OFFSET(PC + 1));					return 12;}
-INSTRUCTION(jr_Z_OFFSET) {BYTE0 &= 223; PC += 2; if (Z) {PC += READ_OFFSET(PC - 1); return 12;} return	7;}
+INSTRUCTION(jp_WORD)	 {IDLE_FROM PC = CODE_16(PC + 1);			IDLE_LOOP(10)	return 10;}
+INSTRUCTION(jp_Z_WORD)	 {IDLE_FROM PC = Z ? CODE_16(PC + 1) : PC + 3;		IDLE_LOOP(10)	return 10;}
+INSTRUCTION(jr_OFFSET)	 {IDLE_FROM PC += (2 + CODE_OFFSET(PC + 1));		IDLE_LOOP(12)	return 12;}
+INSTRUCTION(jr_Z_OFFSET) {IDLE_FROM PC += 2; if (ZZ) {PC += CODE_OFFSET(PC - 1); IDLE_LOOP(12) return 12;} return	7;}
 INSTRUCTION(jp_hl)	 {PC = HL;								return	4;}
 INSTRUCTION(jp_XY)	 {PC = XY;								return	8;}
-INSTRUCTION(djnz_OFFSET) {PC += 2; if (--B) {PC += READ_OFFSET(PC - 1); return 13;}		return	8;}
+INSTRUCTION(djnz_OFFSET) {PC += 2; if (--B) {PC += CODE_OFFSET(PC - 1); return 13;}		return	8;}
 
 
 /* MARK: - Instructions: Call and Return Group
@@ -1229,13 +1826,13 @@ INSTRUCTION(djnz_OFFSET) {PC += 2; if (--B) {PC += READ_OFFSET(PC - 1); return 1
 |  rst N		11nnn111			  ........  3 / 11	 |
 '-------------------------------------------------------------------------------*/
 
-INSTRUCTION(call_WORD)	 {PUSH(PC + 3); PC = READ_16(PC + 1);	    return 17;}
+INSTRUCTION(call_WORD)	 {PUSH(PC + 3); PC = CODE_16(PC + 1); HOOK_CALL(Z80_CALL_INSTRUCTION) return 17;}
 INSTRUCTION(call_Z_WORD) {if (Z) return call_WORD(object); PC += 3; return 10;}
 INSTRUCTION(ret)	 {RET;					    return 10;}
 INSTRUCTION(ret_Z)	 {if (Z) {RET; return 11;} PC++;	    return  5;}
 INSTRUCTION(reti)	 {IFF1 = IFF2; RET;			    return 14;}
 INSTRUCTION(retn)	 {IFF1 = IFF2; RET;			    return 14;}
-INSTRUCTION(rst_N)	 {PUSH(PC + 1); PC = BYTE0 & 56;	    return 11;}
+INSTRUCTION(rst_N)	 {PUSH(PC + 1); PC = BYTE0 & 56; HOOK_CALL(Z80_CALL_RST) return 11;}
 
 
 /* MARK: - Instructions: Input and Output Group
@@ -1259,14 +1856,14 @@ INSTRUCTION(rst_N)	 {PUSH(PC + 1); PC = BYTE0 & 56;	    return 11;}
 |  otdr			<  ED  ><  BB  >		  010*0***  5,4 / 21,16	 |
 '-------------------------------------------------------------------------------*/
 
-INSTRUCTION(in_a_BYTE)	 {A = IN((A << 8) | READ_8((PC += 2) - 1)); return 11;}
+INSTRUCTION(in_a_BYTE)	 {A = IN((A << 8) | CODE_8((PC += 2) - 1)); return 11;}
 INSTRUCTION(in_X_vc)	 {IN_VC; X1 = t;			    return 12;}
 INSTRUCTION(in_0_vc)	 {IN_VC;				    return 16;}
 INSTRUCTION(ini)	 {INX (++, +)				    return 16;}
 INSTRUCTION(inir)	 {INXR(++, +)					      }
 INSTRUCTION(ind)	 {INX (--, -)				    return 16;}
 INSTRUCTION(indr)	 {INXR(--, -)					      }
-INSTRUCTION(out_vBYTE_a) {OUT((A << 8) | READ_8((PC += 2) - 1), A); return 11;}
+INSTRUCTION(out_vBYTE_a) {OUT((A << 8) | CODE_8((PC += 2) - 1), A); return 11;}
 INSTRUCTION(out_vc_X)	 {PC += 2; OUT(BC, X1);			    return 12;}
 INSTRUCTION(out_vc_0)	 {PC += 2; OUT(BC, 0);			    return 12;}
 INSTRUCTION(outi)	 {OUTX(++)				    return 16;}
@@ -1275,6 +1872,107 @@ INSTRUCTION(outd)	 {OUTX(--)				    return 16;}
 INSTRUCTION(otdr)	 {OTXR(--)					      }
 
 
+/* MARK: - Superinstructions
+
+   Optional. The opcodes below start a fused handler that executes the
+   instruction and then, if the loop would immediately go on with one of
+   the listed successors (cycles left and no NMI or INT to accept), also
+   executes it within the same dispatch. The instructions are still the
+   original handlers, so flags, cycles and R are the same as if executed
+   separately. The pairs are the most frequent ones in an opcode pair
+   histogram of the system ROM, plus the typical loops that copy a buffer
+   to a port. The opcode of the next instruction is fetched only once, in
+   the place of z80_run: when it is not a listed successor, the instruction
+   is executed through the table without superinstructions. */
+
+#ifdef CPU_Z80_WITH_SUPERINSTRUCTIONS
+
+	static Instruction const instruction_table[256];
+
+
+#	define FUSION(first)								\
+		zuint8 cycles = first(object);						\
+											\
+		if (BREAKING || CYCLES + cycles >= CYCLE_LIMIT || NMI || (INT && IFF1))	\
+			return cycles;							\
+											\
+		CYCLES += cycles;							\
+		COUNT_INSTRUCTION(cycles)						\
+		TRACE_INSTRUCTION							\
+		TRACE_START								\
+		COVER									\
+		R++;									\
+											\
+		switch (BYTE0 = CODE_8(PC))
+
+#	define FUSE(opcode, second) case opcode: return second(object);
+#	define FUSE_OTHER	     return instruction_table[BYTE0](object);
+
+
+	INSTRUCTION(fused_dec_b)     {FUSION(V_X)	{FUSE(0x20, jr_Z_OFFSET)} FUSE_OTHER}
+	INSTRUCTION(fused_dec_bc)    {FUSION(dec_SS)	{FUSE(0x78, ld_X_Y)}	  FUSE_OTHER}
+	INSTRUCTION(fused_ld_a_BYTE) {FUSION(ld_X_BYTE) {FUSE(0xD3, out_vBYTE_a)} FUSE_OTHER}
+	INSTRUCTION(fused_ld_a_b)    {FUSION(ld_X_Y)	{FUSE(0xB1, U_a_Y)}	  FUSE_OTHER}
+	INSTRUCTION(fused_ld_a_c)    {FUSION(ld_X_Y)	{FUSE(0xE6, U_a_BYTE)}	  FUSE_OTHER}
+	INSTRUCTION(fused_ld_a_h)    {FUSION(ld_X_Y)	{FUSE(0xD3, out_vBYTE_a)} FUSE_OTHER}
+	INSTRUCTION(fused_ld_a_l)    {FUSION(ld_X_Y)	{FUSE(0xD3, out_vBYTE_a)} FUSE_OTHER}
+	INSTRUCTION(fused_or_c)	     {FUSION(U_a_Y)	{FUSE(0x20, jr_Z_OFFSET)} FUSE_OTHER}
+	INSTRUCTION(fused_and_BYTE)  {FUSION(U_a_BYTE)	{FUSE(0x20, jr_Z_OFFSET)} FUSE_OTHER}
+
+
+	INSTRUCTION(fused_ld_a_vhl)
+		{
+		FUSION(ld_X_vhl)
+			{
+			FUSE(0xD3, out_vBYTE_a)
+			FUSE(0x23, inc_SS)
+			}
+
+		FUSE_OTHER
+		}
+
+
+	INSTRUCTION(fused_out_vBYTE_a)
+		{
+		FUSION(out_vBYTE_a)
+			{
+			FUSE(0x0B, dec_SS)
+			FUSE(0x23, inc_SS)
+			FUSE(0x3E, ld_X_BYTE)
+			FUSE(0x10, djnz_OFFSET)
+			}
+
+		FUSE_OTHER
+		}
+
+
+#	define FUSED_05 fused_dec_b
+#	define FUSED_0B fused_dec_bc
+#	define FUSED_3E fused_ld_a_BYTE
+#	define FUSED_78 fused_ld_a_b
+#	define FUSED_79 fused_ld_a_c
+#	define FUSED_7C fused_ld_a_h
+#	define FUSED_7D fused_ld_a_l
+#	define FUSED_7E fused_ld_a_vhl
+#	define FUSED_B1 fused_or_c
+#	define FUSED_D3 fused_out_vBYTE_a
+#	define FUSED_E6 fused_and_BYTE
+
+#endif
+
+#define UNFUSED_05 V_X
+#define UNFUSED_0B dec_SS
+#define UNFUSED_3E ld_X_BYTE
+#define UNFUSED_78 ld_X_Y
+#define UNFUSED_79 ld_X_Y
+#define UNFUSED_7C ld_X_Y
+#define UNFUSED_7D ld_X_Y
+#define UNFUSED_7E ld_X_vhl
+#define UNFUSED_B1 U_a_Y
+#define UNFUSED_D3 out_vBYTE_a
+#define UNFUSED_E6 U_a_BYTE
+
+
 /* MARK: - Opcode Selector Prototypes */
 
 INSTRUCTION(CB);
@@ -1288,105 +1986,125 @@ INSTRUCTION(XY_illegal);
 
 /* MARK: - Instruction Function Tables */
 
-static Instruction const instruction_table[256] = {
-/*	0	     1		 2	      3		   4		5	  6	       7	 8	      9		 A	      B		 C	      D		 E	    F */
-/* 0 */ nop,	     ld_SS_WORD, ld_vbc_a,    inc_SS,	   V_X,		V_X,	  ld_X_BYTE,   rlca,	 ex_af_af_,   add_hl_SS, ld_a_vbc,    dec_SS,	 V_X,	      V_X,	 ld_X_BYTE, rrca,
-/* 1 */ djnz_OFFSET, ld_SS_WORD, ld_vde_a,    inc_SS,	   V_X,		V_X,	  ld_X_BYTE,   rla,	 jr_OFFSET,   add_hl_SS, ld_a_vde,    dec_SS,	 V_X,	      V_X,	 ld_X_BYTE, rra,
-/* 2 */ jr_Z_OFFSET, ld_SS_WORD, ld_vWORD_hl, inc_SS,	   V_X,		V_X,	  ld_X_BYTE,   daa,	 jr_Z_OFFSET, add_hl_SS, ld_hl_vWORD, dec_SS,	 V_X,	      V_X,	 ld_X_BYTE, cpl,
-/* 3 */ jr_Z_OFFSET, ld_SS_WORD, ld_vWORD_a,  inc_SS,	   V_vhl,	V_vhl,	  ld_vhl_BYTE, scf,	 jr_Z_OFFSET, add_hl_SS, ld_a_vWORD,  dec_SS,	 V_X,	      V_X,	 ld_X_BYTE, ccf,
-/* 4 */ ld_X_Y,	     ld_X_Y,	 ld_X_Y,      ld_X_Y,	   ld_X_Y,	ld_X_Y,	  ld_X_vhl,    ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_vhl,  ld_X_Y,
-/* 5 */ ld_X_Y,	     ld_X_Y,	 ld_X_Y,      ld_X_Y,	   ld_X_Y,	ld_X_Y,	  ld_X_vhl,    ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_vhl,  ld_X_Y,
-/* 6 */ ld_X_Y,	     ld_X_Y,	 ld_X_Y,      ld_X_Y,	   ld_X_Y,	ld_X_Y,	  ld_X_vhl,    ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_vhl,  ld_X_Y,
-/* 7 */ ld_vhl_Y,    ld_vhl_Y,	 ld_vhl_Y,    ld_vhl_Y,	   ld_vhl_Y,	ld_vhl_Y, halt,	       ld_vhl_Y, ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_Y,      ld_X_Y,	 ld_X_vhl,  ld_X_Y,
-/* 8 */ U_a_Y,	     U_a_Y,	 U_a_Y,	      U_a_Y,	   U_a_Y,	U_a_Y,	  U_a_vhl,     U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_vhl,   U_a_Y,
-/* 9 */ U_a_Y,	     U_a_Y,	 U_a_Y,	      U_a_Y,	   U_a_Y,	U_a_Y,	  U_a_vhl,     U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_vhl,   U_a_Y,
-/* A */ U_a_Y,	     U_a_Y,	 U_a_Y,	      U_a_Y,	   U_a_Y,	U_a_Y,	  U_a_vhl,     U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_vhl,   U_a_Y,
-/* B */ U_a_Y,	     U_a_Y,	 U_a_Y,	      U_a_Y,	   U_a_Y,	U_a_Y,	  U_a_vhl,     U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_Y,	      U_a_Y,	 U_a_vhl,   U_a_Y,
-/* C */ ret_Z,	     pop_TT,	 jp_Z_WORD,   jp_WORD,	   call_Z_WORD,	push_TT,  U_a_BYTE,    rst_N,	 ret_Z,	      ret,	 jp_Z_WORD,   CB,	 call_Z_WORD, call_WORD, U_a_BYTE,  rst_N,
-/* D */ ret_Z,	     pop_TT,	 jp_Z_WORD,   out_vBYTE_a, call_Z_WORD,	push_TT,  U_a_BYTE,    rst_N,	 ret_Z,	      exx,	 jp_Z_WORD,   in_a_BYTE, call_Z_WORD, DD,	 U_a_BYTE,  rst_N,
-/* E */ ret_Z,	     pop_TT,	 jp_Z_WORD,   ex_vsp_hl,   call_Z_WORD,	push_TT,  U_a_BYTE,    rst_N,	 ret_Z,	      jp_hl,	 jp_Z_WORD,   ex_de_hl,	 call_Z_WORD, ED,	 U_a_BYTE,  rst_N,
-/* F */ ret_Z,	     pop_TT,	 jp_Z_WORD,   di,	   call_Z_WORD,	push_TT,  U_a_BYTE,    rst_N,	 ret_Z,	      ld_sp_hl,	 jp_Z_WORD,   ei,	 call_Z_WORD, FD,	 U_a_BYTE,  rst_N
-};
-
-static Instruction const instruction_table_CB[256] = {
-/*	0	 1	  2	   3	    4	     5	      6		 7	  8	   9	    A	     B	      C	       D	E	   F */
-/* 0 */ G_Y,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_vhl,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_Y,     G_Y,	G_vhl,	   G_Y,
-/* 1 */ G_Y,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_vhl,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_Y,     G_Y,	G_vhl,	   G_Y,
-/* 2 */ G_Y,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_vhl,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_Y,     G_Y,	G_vhl,	   G_Y,
-/* 3 */ G_Y,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_vhl,	 G_Y,	  G_Y,	   G_Y,	    G_Y,     G_Y,     G_Y,     G_Y,	G_vhl,	   G_Y,
-/* 4 */ bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y,
-/* 5 */ bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y,
-/* 6 */ bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y,
-/* 7 */ bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_Y, bit_N_vhl, bit_N_Y,
-/* 8 */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y,
-/* 9 */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y,
-/* A */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y,
-/* B */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y,
-/* C */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y,
-/* D */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y,
-/* E */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y,
-/* F */ M_N_Y,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_vhl,	 M_N_Y,	  M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,   M_N_Y,	M_N_vhl,   M_N_Y
-};
-
-static Instruction const instruction_table_XY_CB[256] = {
-/*	0		 1		  2		   3		    4		     5		      6		       7		8		 9		  A		   B		    C		     D		      E		       F */
-/* 0 */ G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,	G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,
-/* 1 */ G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,	G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,
-/* 2 */ G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,	G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,
-/* 3 */ G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,	G_vXYOFFSET_Y,	 G_vXYOFFSET_Y,	  G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET_Y,   G_vXYOFFSET,     G_vXYOFFSET_Y,
-/* 4 */ bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET,
-/* 5 */ bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET,
-/* 6 */ bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET,
-/* 7 */ bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET, bit_N_vXYOFFSET,
-/* 8 */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y,
-/* 9 */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y,
-/* A */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y,
-/* B */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y,
-/* C */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y,
-/* D */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y,
-/* E */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y,
-/* F */ M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET_Y, M_N_vXYOFFSET,   M_N_vXYOFFSET_Y
-};
-
-static Instruction const instruction_table_XY[256] = {
-/*	0		1		2		3		4		5		6		   7		   8	       9	   A		B	    C		D	    E		    F */
-/* 0 */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	   XY_illegal,	   XY_illegal, add_XY_WW,  XY_illegal,	XY_illegal, XY_illegal, XY_illegal, XY_illegal,	    XY_illegal,
-/* 1 */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	   XY_illegal,	   XY_illegal, add_XY_WW,  XY_illegal,	XY_illegal, XY_illegal, XY_illegal, XY_illegal,	    XY_illegal,
-/* 2 */ XY_illegal,	ld_XY_WORD,	ld_vWORD_XY,	inc_XY,		V_JP,		V_JP,		ld_JP_BYTE,	   XY_illegal,	   XY_illegal, add_XY_WW,  ld_XY_vWORD, dec_XY,	    V_JP,	V_JP,	    ld_JP_BYTE,	    XY_illegal,
-/* 3 */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	V_vXYOFFSET,	V_vXYOFFSET,	ld_vXYOFFSET_BYTE, XY_illegal,	   XY_illegal, add_XY_WW,  XY_illegal,	XY_illegal, XY_illegal, XY_illegal, XY_illegal,	    XY_illegal,
-/* 4 */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	ld_JP_KQ,	ld_JP_KQ,	ld_X_vXYOFFSET,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_illegal, ld_JP_KQ,	ld_JP_KQ,   ld_X_vXYOFFSET, XY_illegal,
-/* 5 */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	ld_JP_KQ,	ld_JP_KQ,	ld_X_vXYOFFSET,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_illegal, ld_JP_KQ,	ld_JP_KQ,   ld_X_vXYOFFSET, XY_illegal,
-/* 6 */ ld_JP_KQ,	ld_JP_KQ,	ld_JP_KQ,	ld_JP_KQ,	ld_JP_KQ,	ld_JP_KQ,	ld_X_vXYOFFSET,	   ld_JP_KQ,	   ld_JP_KQ,   ld_JP_KQ,   ld_JP_KQ,	ld_JP_KQ,   ld_JP_KQ,	ld_JP_KQ,   ld_X_vXYOFFSET, ld_JP_KQ,
-/* 7 */ ld_vXYOFFSET_Y, ld_vXYOFFSET_Y, ld_vXYOFFSET_Y, ld_vXYOFFSET_Y, ld_vXYOFFSET_Y, ld_vXYOFFSET_Y, XY_illegal,	   ld_vXYOFFSET_Y, XY_illegal, XY_illegal, XY_illegal,	XY_illegal, ld_JP_KQ,	ld_JP_KQ,   ld_X_vXYOFFSET, XY_illegal,
-/* 8 */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	U_a_KQ,		U_a_KQ,		U_a_vXYOFFSET,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_illegal, U_a_KQ,	U_a_KQ,	    U_a_vXYOFFSET,  XY_illegal,
-/* 9 */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	U_a_KQ,		U_a_KQ,		U_a_vXYOFFSET,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_illegal, U_a_KQ,	U_a_KQ,	    U_a_vXYOFFSET,  XY_illegal,
-/* A */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	U_a_KQ,		U_a_KQ,		U_a_vXYOFFSET,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_illegal, U_a_KQ,	U_a_KQ,	    U_a_vXYOFFSET,  XY_illegal,
-/* B */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	U_a_KQ,		U_a_KQ,		U_a_vXYOFFSET,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_illegal, U_a_KQ,	U_a_KQ,	    U_a_vXYOFFSET,  XY_illegal,
-/* C */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_CB,	    XY_illegal, XY_illegal, XY_illegal,	    XY_illegal,
-/* D */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	   XY_illegal,	   XY_illegal, XY_illegal, XY_illegal,	XY_illegal, XY_illegal, XY_illegal, XY_illegal,	    XY_illegal,
-/* E */ XY_illegal,	pop_XY,		XY_illegal,	ex_vsp_XY,	XY_illegal,	push_XY,	XY_illegal,	   XY_illegal,	   XY_illegal, jp_XY,	   XY_illegal,	XY_illegal, XY_illegal, XY_illegal, XY_illegal,	    XY_illegal,
-/* F */ XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	XY_illegal,	   XY_illegal,	   XY_illegal, ld_sp_XY,   XY_illegal,	XY_illegal, XY_illegal, XY_illegal, XY_illegal,	    XY_illegal
-};
+#define INSTRUCTION_TABLE(_)																														\
+/*	0		1		2		3		4		5		6		7		8		9		A		B		C		D		E		F */		\
+/* 0 */ _(nop),		_(ld_SS_WORD),	_(ld_vbc_a),	_(inc_SS),	_(V_X),		_(SUPER(05)),	_(ld_X_BYTE),	_(rlca),	_(ex_af_af_),	_(add_hl_SS),	_(ld_a_vbc),	_(SUPER(0B)),	_(V_X),		_(V_X),		_(ld_X_BYTE),	_(rrca),	\
+/* 1 */ _(djnz_OFFSET), _(ld_SS_WORD),	_(ld_vde_a),	_(inc_SS),	_(V_X),		_(V_X),		_(ld_X_BYTE),	_(rla),		_(jr_OFFSET),	_(add_hl_SS),	_(ld_a_vde),	_(dec_SS),	_(V_X),		_(V_X),		_(ld_X_BYTE),	_(rra),		\
+/* 2 */ _(jr_Z_OFFSET), _(ld_SS_WORD),	_(ld_vWORD_hl), _(inc_SS),	_(V_X),		_(V_X),		_(ld_X_BYTE),	_(daa),		_(jr_Z_OFFSET), _(add_hl_SS),	_(ld_hl_vWORD), _(dec_SS),	_(V_X),		_(V_X),		_(ld_X_BYTE),	_(cpl),		\
+/* 3 */ _(jr_Z_OFFSET), _(ld_SS_WORD),	_(ld_vWORD_a),	_(inc_SS),	_(V_vhl),	_(V_vhl),	_(ld_vhl_BYTE), _(scf),		_(jr_Z_OFFSET), _(add_hl_SS),	_(ld_a_vWORD),	_(dec_SS),	_(V_X),		_(V_X),		_(SUPER(3E)),	_(ccf),		\
+/* 4 */ _(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_vhl),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_vhl),	_(ld_X_Y),	\
+/* 5 */ _(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_vhl),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_vhl),	_(ld_X_Y),	\
+/* 6 */ _(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_vhl),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_Y),	_(ld_X_vhl),	_(ld_X_Y),	\
+/* 7 */ _(ld_vhl_Y),	_(ld_vhl_Y),	_(ld_vhl_Y),	_(ld_vhl_Y),	_(ld_vhl_Y),	_(ld_vhl_Y),	_(halt),	_(ld_vhl_Y),	_(SUPER(78)),	_(SUPER(79)),	_(ld_X_Y),	_(ld_X_Y),	_(SUPER(7C)),	_(SUPER(7D)),	_(SUPER(7E)),	_(ld_X_Y),	\
+/* 8 */ _(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	\
+/* 9 */ _(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	\
+/* A */ _(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	\
+/* B */ _(U_a_Y),	_(SUPER(B1)),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_Y),	_(U_a_vhl),	_(U_a_Y),	\
+/* C */ _(ret_Z),	_(pop_TT),	_(jp_Z_WORD),	_(jp_WORD),	_(call_Z_WORD), _(push_TT),	_(U_a_BYTE),	_(rst_N),	_(ret_Z),	_(ret),		_(jp_Z_WORD),	_(CB),		_(call_Z_WORD), _(call_WORD),	_(U_a_BYTE),	_(rst_N),	\
+/* D */ _(ret_Z),	_(pop_TT),	_(jp_Z_WORD),	_(SUPER(D3)),	_(call_Z_WORD), _(push_TT),	_(U_a_BYTE),	_(rst_N),	_(ret_Z),	_(exx),		_(jp_Z_WORD),	_(in_a_BYTE),	_(call_Z_WORD), _(DD),		_(U_a_BYTE),	_(rst_N),	\
+/* E */ _(ret_Z),	_(pop_TT),	_(jp_Z_WORD),	_(ex_vsp_hl),	_(call_Z_WORD), _(push_TT),	_(SUPER(E6)),	_(rst_N),	_(ret_Z),	_(jp_hl),	_(jp_Z_WORD),	_(ex_de_hl),	_(call_Z_WORD), _(ED),		_(U_a_BYTE),	_(rst_N),	\
+/* F */ _(ret_Z),	_(pop_TT),	_(jp_Z_WORD),	_(di),		_(call_Z_WORD), _(push_TT),	_(U_a_BYTE),	_(rst_N),	_(ret_Z),	_(ld_sp_hl),	_(jp_Z_WORD),	_(ei),		_(call_Z_WORD), _(FD),		_(U_a_BYTE),	_(rst_N)
+
+#define SUPER(opcode) UNFUSED_##opcode
+
+static Instruction const instruction_table[256] = {INSTRUCTION_TABLE(Z_SAME)};
+
+/* Only the loops use the table with superinstructions, the handlers need
+   one instruction per call. */
+#ifdef CPU_Z80_WITH_SUPERINSTRUCTIONS
+#	undef SUPER
+#	define SUPER(opcode) FUSED_##opcode
+
+#	ifndef CPU_Z80_WITH_THREADED_DISPATCH
+		static Instruction const instruction_table_fused[256] = {INSTRUCTION_TABLE(Z_SAME)};
+#	endif
+#else
+#	define instruction_table_fused instruction_table
+#endif
 
-static Instruction const instruction_table_ED[256] = {
-/*	0	    1		2	    3		 4	     5		 6	     7		 8	     9		 A	     B		  C	      D		  E	      F */
-/* 0 */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* 1 */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* 2 */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* 3 */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* 4 */ in_X_vc,    out_vc_X,	sbc_hl_SS,  ld_vWORD_SS, neg,	     retn,	 im_0,	     ld_i_a,	 in_X_vc,    out_vc_X,	 adc_hl_SS,  ld_SS_vWORD, neg,	      reti,	  im_0,	      ld_r_a,
-/* 5 */ in_X_vc,    out_vc_X,	sbc_hl_SS,  ld_vWORD_SS, neg,	     retn,	 im_1,	     ld_a_i,	 in_X_vc,    out_vc_X,	 adc_hl_SS,  ld_SS_vWORD, neg,	      retn,	  im_2,	      ld_a_r,
-/* 6 */ in_X_vc,    out_vc_X,	sbc_hl_SS,  ld_vWORD_SS, neg,	     retn,	 im_0,	     rrd,	 in_X_vc,    out_vc_X,	 adc_hl_SS,  ld_SS_vWORD, neg,	      retn,	  im_0,	      rld,
-/* 7 */ in_0_vc,    out_vc_0,	sbc_hl_SS,  ld_vWORD_SS, neg,	     retn,	 im_1,	     ED_illegal, in_X_vc,    out_vc_X,	 adc_hl_SS,  ld_SS_vWORD, neg,	      retn,	  im_2,	      ED_illegal,
-/* 8 */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* 9 */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* A */ ldi,	    cpi,	ini,	    outi,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ldd,	     cpd,	 ind,	     outd,	  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* B */ ldir,	    cpir,	inir,	    otir,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, lddr,	     cpdr,	 indr,	     otdr,	  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* C */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* D */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* E */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal,
-/* F */ ED_illegal, ED_illegal, ED_illegal, ED_illegal,	 ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal, ED_illegal,  ED_illegal, ED_illegal, ED_illegal, ED_illegal
-};
+#define INSTRUCTION_TABLE_CB(_)																										\
+/*	0	      1		    2		  3		4	      5		    6		  7		8	      9		    A		  B		C	      D		    E		  F */		\
+/* 0 */ _(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	\
+/* 1 */ _(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	\
+/* 2 */ _(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	\
+/* 3 */ _(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_Y),	  _(G_Y),	_(G_Y),	      _(G_Y),	    _(G_vhl),	  _(G_Y),	\
+/* 4 */ _(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	\
+/* 5 */ _(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	\
+/* 6 */ _(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	\
+/* 7 */ _(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_Y),	  _(bit_N_Y),	_(bit_N_Y),   _(bit_N_Y),   _(bit_N_vhl), _(bit_N_Y),	\
+/* 8 */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	\
+/* 9 */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	\
+/* A */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	\
+/* B */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	\
+/* C */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	\
+/* D */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	\
+/* E */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	\
+/* F */ _(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_Y),	  _(M_N_Y),	_(M_N_Y),     _(M_N_Y),	    _(M_N_vhl),	  _(M_N_Y)
+
+static Instruction const instruction_table_CB[256] = {INSTRUCTION_TABLE_CB(Z_SAME)};
+
+#define INSTRUCTION_TABLE_XY_CB(_)																																					\
+/*	0		    1			2		    3			4		    5			6		    7			8		    9			A		    B			C		    D			E		    F */		\
+/* 0 */ _(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	\
+/* 1 */ _(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	\
+/* 2 */ _(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	\
+/* 3 */ _(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET_Y),   _(G_vXYOFFSET_Y),	_(G_vXYOFFSET),	    _(G_vXYOFFSET_Y),	\
+/* 4 */ _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), \
+/* 5 */ _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), \
+/* 6 */ _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), \
+/* 7 */ _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), _(bit_N_vXYOFFSET), \
+/* 8 */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), \
+/* 9 */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), \
+/* A */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), \
+/* B */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), \
+/* C */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), \
+/* D */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), \
+/* E */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), \
+/* F */ _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET_Y), _(M_N_vXYOFFSET),   _(M_N_vXYOFFSET_Y)
+
+static Instruction const instruction_table_XY_CB[256] = {INSTRUCTION_TABLE_XY_CB(Z_SAME)};
+
+#define INSTRUCTION_TABLE_XY(_)																																										\
+/*	0		      1			    2			  3			4		      5			    6			  7			8		      9			    A			  B			C		      D			    E			  F */			\
+/* 0 */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(add_XY_WW),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	\
+/* 1 */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(add_XY_WW),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	\
+/* 2 */ _(XY_illegal),	      _(ld_XY_WORD),	    _(ld_vWORD_XY),	  _(inc_XY),		_(V_JP),	      _(V_JP),		    _(ld_JP_BYTE),	  _(XY_illegal),	_(XY_illegal),	      _(add_XY_WW),	    _(ld_XY_vWORD),	  _(dec_XY),		_(V_JP),	      _(V_JP),		    _(ld_JP_BYTE),	  _(XY_illegal),	\
+/* 3 */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(V_vXYOFFSET),	      _(V_vXYOFFSET),	    _(ld_vXYOFFSET_BYTE), _(XY_illegal),	_(XY_illegal),	      _(add_XY_WW),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	\
+/* 4 */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_X_vXYOFFSET),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_X_vXYOFFSET),	  _(XY_illegal),	\
+/* 5 */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_X_vXYOFFSET),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_X_vXYOFFSET),	  _(XY_illegal),	\
+/* 6 */ _(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_JP_KQ),	  _(ld_JP_KQ),		_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_X_vXYOFFSET),	  _(ld_JP_KQ),		_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_JP_KQ),	  _(ld_JP_KQ),		_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_X_vXYOFFSET),	  _(ld_JP_KQ),		\
+/* 7 */ _(ld_vXYOFFSET_Y),    _(ld_vXYOFFSET_Y),    _(ld_vXYOFFSET_Y),	  _(ld_vXYOFFSET_Y),	_(ld_vXYOFFSET_Y),    _(ld_vXYOFFSET_Y),    _(XY_illegal),	  _(ld_vXYOFFSET_Y),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(ld_JP_KQ),	      _(ld_JP_KQ),	    _(ld_X_vXYOFFSET),	  _(XY_illegal),	\
+/* 8 */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	\
+/* 9 */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	\
+/* A */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	\
+/* B */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(U_a_KQ),	      _(U_a_KQ),	    _(U_a_vXYOFFSET),	  _(XY_illegal),	\
+/* C */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_CB),		_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	\
+/* D */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	\
+/* E */ _(XY_illegal),	      _(pop_XY),	    _(XY_illegal),	  _(ex_vsp_XY),		_(XY_illegal),	      _(push_XY),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(jp_XY),		    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	\
+/* F */ _(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(ld_sp_XY),	    _(XY_illegal),	  _(XY_illegal),	_(XY_illegal),	      _(XY_illegal),	    _(XY_illegal),	  _(XY_illegal)
+
+static Instruction const instruction_table_XY[256] = {INSTRUCTION_TABLE_XY(Z_SAME)};
+
+#define INSTRUCTION_TABLE_ED(_)																														\
+/*	0		1		2		3		4		5		6		7		8		9		A		B		C		D		E		F */		\
+/* 0 */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* 1 */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* 2 */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* 3 */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* 4 */ _(in_X_vc),	_(out_vc_X),	_(sbc_hl_SS),	_(ld_vWORD_SS), _(neg),		_(retn),	_(im_0),	_(ld_i_a),	_(in_X_vc),	_(out_vc_X),	_(adc_hl_SS),	_(ld_SS_vWORD), _(neg),		_(reti),	_(im_0),	_(ld_r_a),	\
+/* 5 */ _(in_X_vc),	_(out_vc_X),	_(sbc_hl_SS),	_(ld_vWORD_SS), _(neg),		_(retn),	_(im_1),	_(ld_a_i),	_(in_X_vc),	_(out_vc_X),	_(adc_hl_SS),	_(ld_SS_vWORD), _(neg),		_(retn),	_(im_2),	_(ld_a_r),	\
+/* 6 */ _(in_X_vc),	_(out_vc_X),	_(sbc_hl_SS),	_(ld_vWORD_SS), _(neg),		_(retn),	_(im_0),	_(rrd),		_(in_X_vc),	_(out_vc_X),	_(adc_hl_SS),	_(ld_SS_vWORD), _(neg),		_(retn),	_(im_0),	_(rld),		\
+/* 7 */ _(in_0_vc),	_(out_vc_0),	_(sbc_hl_SS),	_(ld_vWORD_SS), _(neg),		_(retn),	_(im_1),	_(ED_illegal),	_(in_X_vc),	_(out_vc_X),	_(adc_hl_SS),	_(ld_SS_vWORD), _(neg),		_(retn),	_(im_2),	_(ED_illegal),	\
+/* 8 */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* 9 */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* A */ _(ldi),		_(cpi),		_(ini),		_(outi),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ldd),		_(cpd),		_(ind),		_(outd),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* B */ _(ldir),	_(cpir),	_(inir),	_(otir),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(lddr),	_(cpdr),	_(indr),	_(otdr),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* C */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* D */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* E */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	\
+/* F */ _(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal),	_(ED_illegal)
+
+static Instruction const instruction_table_ED[256] = {INSTRUCTION_TABLE_ED(Z_SAME)};
 
 
 /* MARK: - Prefixed Instruction Set Selection and Execution */
@@ -1396,22 +2114,22 @@ static Instruction const instruction_table_ED[256] = {
 								       \
 	XY = register;						       \
 	R++;							       \
-	cycles = instruction_table_XY[BYTE1 = READ_8(PC + 1)](object); \
+	cycles = instruction_table_XY[BYTE1 = CODE_8(PC + 1)](object); \
 	register = XY;						       \
 	return cycles;
 
 
 INSTRUCTION(DD) {DD_FD(IX)}
 INSTRUCTION(FD) {DD_FD(IY)}
-INSTRUCTION(CB) {R++; return instruction_table_CB[BYTE1 = READ_8((PC += 2) - 1)](object);}
-INSTRUCTION(ED) {R++; return instruction_table_ED[BYTE1 = READ_8( PC	   + 1)](object);}
+INSTRUCTION(CB) {R++; return instruction_table_CB[BYTE1 = CODE_8((PC += 2) - 1)](object);}
+INSTRUCTION(ED) {R++; return instruction_table_ED[BYTE1 = CODE_8( PC	   + 1)](object);}
 
 
 INSTRUCTION(XY_CB)
 	{
 	PC += 4;
-	BYTE2 = READ_8(PC - 2);
-	return instruction_table_XY_CB[BYTE3 = READ_8(PC - 1)](object);
+	BYTE2 = CODE_8(PC - 2);
+	return instruction_table_XY_CB[BYTE3 = CODE_8(PC - 1)](object);
 	}
 
 
@@ -1421,6 +2139,118 @@ INSTRUCTION(XY_illegal) {PC += 1; return instruction_table[BYTE0 = BYTE1](object
 INSTRUCTION(ED_illegal) {PC += 2; return 8;}
 
 
+/* MARK: - Threaded Dispatch */
+
+/* Optional build mode based on the "labels as values" extension of GCC and
+   Clang. Each instruction function gets a label inside z80_run where it is
+   called directly (so the compiler can inline it), and every label ends by
+   fetching the next opcode and jumping straight to the label of its handler,
+   without going back through the loop. Prefixes jump to the label tables of
+   their instruction sets. The function tables above remain the portable
+   implementation used by default. */
+
+#ifdef CPU_Z80_WITH_THREADED_DISPATCH
+
+#	if !defined(__GNUC__)
+#		error "CPU_Z80_WITH_THREADED_DISPATCH requires a compiler with labels as values."
+#	endif
+
+#	define THREADED_INSTRUCTIONS(_)										\
+		_(nop)	       _(ld_SS_WORD)  _(ld_vbc_a)    _(inc_SS)	    _(V_X)	   _(ld_X_BYTE)		\
+		_(rlca)	       _(ex_af_af_)   _(add_hl_SS)   _(ld_a_vbc)    _(dec_SS)	   _(rrca)		\
+		_(djnz_OFFSET) _(ld_vde_a)    _(rla)	     _(jr_OFFSET)   _(ld_a_vde)	   _(rra)		\
+		_(jr_Z_OFFSET) _(ld_vWORD_hl) _(daa)	     _(ld_hl_vWORD) _(cpl)	   _(ld_vWORD_a)	\
+		_(V_vhl)       _(ld_vhl_BYTE) _(scf)	     _(ld_a_vWORD)  _(ccf)	   _(ld_X_Y)		\
+		_(ld_X_vhl)    _(ld_vhl_Y)    _(halt)	     _(U_a_Y)	    _(U_a_vhl)	   _(ret_Z)		\
+		_(pop_TT)      _(jp_Z_WORD)   _(jp_WORD)     _(call_Z_WORD) _(push_TT)	   _(U_a_BYTE)		\
+		_(rst_N)       _(ret)	      _(call_WORD)   _(exx)	    _(in_a_BYTE)   _(ex_vsp_hl)		\
+		_(jp_hl)       _(ex_de_hl)    _(di)	     _(ld_sp_hl)    _(ei)
+
+#	define THREADED_INSTRUCTIONS_CB(_)							\
+		_(G_Y)	     _(G_vhl)	  _(bit_N_Y)   _(bit_N_vhl) _(M_N_Y)	 _(M_N_vhl)
+
+#	define THREADED_INSTRUCTIONS_ED(_)								\
+		_(ED_illegal)  _(in_X_vc)     _(out_vc_X)    _(sbc_hl_SS)   _(ld_vWORD_SS) _(neg)	\
+		_(retn)	       _(im_0)	      _(ld_i_a)	     _(adc_hl_SS)   _(ld_SS_vWORD) _(reti)	\
+		_(ld_r_a)      _(im_1)	      _(ld_a_i)	     _(im_2)	    _(ld_a_r)	   _(rrd)	\
+		_(rld)	       _(in_0_vc)     _(out_vc_0)    _(ldi)	    _(cpi)	   _(ini)	\
+		_(outi)	       _(ldd)	      _(cpd)	     _(ind)	    _(outd)	   _(ldir)	\
+		_(cpir)	       _(inir)	      _(otir)	     _(lddr)	    _(cpdr)	   _(indr)	\
+		_(otdr)
+
+#	define THREADED_INSTRUCTIONS_XY(_)													\
+		_(XY_illegal)	     _(add_XY_WW)	  _(ld_XY_WORD)	       _(ld_vWORD_XY)	    _(inc_XY)		 _(V_JP)		\
+		_(ld_JP_BYTE)	     _(ld_XY_vWORD)	  _(dec_XY)	       _(V_vXYOFFSET)	    _(ld_vXYOFFSET_BYTE) _(ld_JP_KQ)		\
+		_(ld_X_vXYOFFSET)    _(ld_vXYOFFSET_Y)	  _(U_a_KQ)	       _(U_a_vXYOFFSET)	    _(pop_XY)		 _(ex_vsp_XY)		\
+		_(push_XY)	     _(jp_XY)		  _(ld_sp_XY)	       _(G_vXYOFFSET_Y)	    _(G_vXYOFFSET)	 _(bit_N_vXYOFFSET)	\
+		_(M_N_vXYOFFSET_Y)   _(M_N_vXYOFFSET)
+
+	/* Handlers only referenced by the SUPER cells of the primary table. */
+#	ifdef CPU_Z80_WITH_SUPERINSTRUCTIONS
+#		define THREADED_INSTRUCTIONS_SUPER(_)						\
+			_(fused_dec_b)	  _(fused_dec_bc)    _(fused_ld_a_BYTE)	 _(fused_ld_a_b)	\
+			_(fused_ld_a_c)	  _(fused_ld_a_h)    _(fused_ld_a_l)	 _(fused_ld_a_vhl)	\
+			_(fused_or_c)	  _(fused_and_BYTE)  _(fused_out_vBYTE_a)
+#	else
+#		define THREADED_INSTRUCTIONS_SUPER(_) _(out_vBYTE_a)
+#	endif
+
+	/* Two steps, so that the SUPER cells are expanded before pasting. */
+#	define THREADED_LABEL(name)	   THREADED_LABEL_EXPANDED(name)
+#	define THREADED_LABEL_EXPANDED(name) &&threaded_##name
+
+#	define THREADED_DISPATCH(table, opcode) goto *table[opcode]
+
+	/*--------------------------------------------------------------------.
+	| Continue with the next instruction only if the loop would do it too |
+	| (no NMI or INT to accept and cycles left); otherwise return to the  |
+	| loop, which will handle the pending event or finish the execution.  |
+	'--------------------------------------------------------------------*/
+	/* While tracing, every instruction returns to the loop so that it
+	   notes where the next one starts. So does it while there are
+	   conditions to stop at, so that the loop tests them. */
+#	ifdef CPU_Z80_WITH_TRACE
+#		define THREADED_STAY_TRACE object->trace == NULL &&
+#	else
+#		define THREADED_STAY_TRACE
+#	endif
+
+#	ifdef CPU_Z80_WITH_BREAKPOINTS
+#		define THREADED_STAY_BREAKPOINTS !object->stops &&
+#	else
+#		define THREADED_STAY_BREAKPOINTS
+#	endif
+
+#	define THREADED_STAY THREADED_STAY_TRACE THREADED_STAY_BREAKPOINTS
+
+#	define THREADED_NEXT									\
+		if (THREADED_STAY CYCLES < CYCLE_LIMIT && !NMI && !(INT && IFF1 && !EI))	\
+			{									\
+			R++;									\
+			EI = FALSE;								\
+			COVER									\
+			THREADED_DISPATCH(threaded_table, BYTE0 = CODE_8(PC));			\
+			}									\
+		continue;
+
+#	define THREADED_INSTRUCTION(name) \
+		threaded_##name: ADD_CYCLES(name(object)) THREADED_NEXT
+
+	/* The index register is written back before ADD_CYCLES so that the
+	   trace sees it. */
+#	define THREADED_INSTRUCTION_XY(name)				 \
+		threaded_##name:					 \
+			{						 \
+			zuint8 xy_cycles = name(object);		 \
+									 \
+			if (iy) IY = XY; else IX = XY;			 \
+			ADD_CYCLES(xy_cycles)				 \
+			}						 \
+		THREADED_NEXT
+
+#endif
+
+
 /* MARK: - Main Functions */
 
 CPU_Z80_API void z80_power(Z80 *object, zboolean state)
@@ -1485,10 +2315,27 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 	{
 	zuint32 data;
 
+#	ifdef CPU_Z80_WITH_THREADED_DISPATCH
+		static void const *const threaded_table	     [256] = {INSTRUCTION_TABLE	     (THREADED_LABEL)};
+		static void const *const threaded_table_CB   [256] = {INSTRUCTION_TABLE_CB   (THREADED_LABEL)};
+		static void const *const threaded_table_ED   [256] = {INSTRUCTION_TABLE_ED   (THREADED_LABEL)};
+		static void const *const threaded_table_XY   [256] = {INSTRUCTION_TABLE_XY   (THREADED_LABEL)};
+		static void const *const threaded_table_XY_CB[256] = {INSTRUCTION_TABLE_XY_CB(THREADED_LABEL)};
+		zboolean iy = FALSE;
+#	endif
+
 	/*-------------.
 	| Clear cycles |
 	'-------------*/
 	CYCLES = 0;
+	CYCLE_LIMIT = cycles;
+
+#	ifdef CPU_Z80_WITH_IDLE_LOOPS
+		/*-------------------------------------------------------------.
+		| The host may have changed memory or devices since last call |
+		'-------------------------------------------------------------*/
+		object->idle_clean = FALSE;
+#	endif
 
 	/*--------------.
 	| Backup R7 bit |
@@ -1498,8 +2345,64 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 	/*------------------------------.
 	| Execute until cycles consumed |
 	'------------------------------*/
-	while (CYCLES < cycles)
+	while (CYCLES < CYCLE_LIMIT)
 		{
+#		ifdef CPU_Z80_WITH_BREAKPOINTS
+			/*---------------------------------------------------------.
+			| Stop where a condition is met if the callback lowers the |
+			| limit, unless this is where the last call stopped.	   |
+			'---------------------------------------------------------*/
+			if (object->stops)
+				{
+				if (!object->breakpoint_hit && object->breakpoint != NULL)
+					{
+					zuint8 reasons = 0;
+
+					if (	(object->stops & Z80_STOP_BREAKPOINTS) &&
+						(object->breakpoints[PC >> 3] & (1 << (PC & 7)))
+					)
+						reasons = Z80_STOP_BREAKPOINTS;
+
+					if ((object->stops & Z80_STOP_INSTRUCTIONS) && !object->instructions_left)
+						{
+						object->stops &= ~Z80_STOP_INSTRUCTIONS;
+						reasons |= Z80_STOP_INSTRUCTIONS;
+						}
+
+					/* The condition may test the flags. */
+					if (object->stops & Z80_STOP_CHECK)
+						{
+#						ifdef CPU_Z80_WITH_LAZY_FLAGS
+							flags(object);
+#						endif
+
+						if (object->check(object->context, PC))
+							reasons |= Z80_STOP_CHECK;
+						}
+
+					if (reasons)
+						{
+						object->breakpoint(object->context, PC, reasons);
+
+						if (CYCLES >= CYCLE_LIMIT)
+							{
+							object->breakpoint_hit = TRUE;
+							break;
+							}
+						}
+					}
+
+				object->breakpoint_hit = FALSE;
+				object->break_pc       = PC;
+
+				/* Count the instruction, unless an interrupt comes first. */
+				if (	(object->stops & Z80_STOP_INSTRUCTIONS) && object->instructions_left &&
+					!NMI && !(INT && IFF1 && !EI)
+				)
+					object->instructions_left--;
+				}
+#		endif
+
 		/*--------------------------------------.
 		| Jump to NMI handler if NMI pending... |
 		'--------------------------------------*/
@@ -1512,7 +2415,10 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 			IFF1 = 0;			/* Reset IFF1 to don't bother the NMI routine.		   */
 			PUSH(PC);			/* Save return addres in the stack.			   */
 			PC = Z_Z80_ADDRESS_NMI_POINTER;	/* Make PC point to the NMI routine.			   */
+			HOOK_CALL(Z80_CALL_NMI)
 			CYCLES += 11;			/* Accepting a NMI consumes 11 cycles.			   */
+			COUNT_INTERRUPT(nmi_count, 11)
+			TRACE_INTERRUPT(Z80_TRACE_NMI, 0)
 			continue;
 			}
 
@@ -1521,6 +2427,10 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 		'--------------------------*/
 		if (INT && IFF1 && !EI)
 			{
+#			ifdef CPU_Z80_WITH_HISTOGRAM
+				zusize start = CYCLES;
+#			endif
+
 			EXIT_HALT;	 /* Resume CPU on halt.		*/
 			R++;		 /* Consume memory refresh.	*/
 			IFF1 = IFF2 = 0; /* Clear interrupt flip-flops.	*/
@@ -1542,12 +2452,14 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 					case Z_UINT32(0xCD000000): /* CALL */
 					PUSH(PC);
 					PC = (zuint16)(data >> 8);
+					HOOK_CALL(Z80_CALL_INT)
 					CYCLES += 17;
 					break;
 
 					default: /* RST (and possibly others) */
 					PUSH(PC);
 					PC = (zuint16)((data >> 8) & 0x38);
+					HOOK_CALL(Z80_CALL_INT)
 					CYCLES += 11;
 					}
 
@@ -1560,6 +2472,7 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 				case 1:
 				PUSH(PC);
 				PC = 0x38;
+				HOOK_CALL(Z80_CALL_INT)
 				CYCLES += (11 + 2);
 				break;
 
@@ -1569,10 +2482,13 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 				case 2:
 				PUSH(PC);
 				PC = READ_16(((zuint16)(I << 8)) | (INT_DATA & 0xFF));
+				HOOK_CALL(Z80_CALL_INT)
 				CYCLES += (17 + 2);
 				break;
 				}
 
+			COUNT_INTERRUPT(int_count[IM], CYCLES - start)
+			TRACE_INTERRUPT(Z80_TRACE_INTERRUPT, IM)
 			continue;
 			}
 
@@ -1581,18 +2497,65 @@ CPU_Z80_API zusize z80_run(Z80 *object, zusize cycles)
 		'---------------------------------------*/
 		R++;
 		EI = FALSE;
+		TRACE_START
+		COVER
 
 		/*-----------------------------------------------.
 		| Execute instruction and update consumed cycles |
 		'-----------------------------------------------*/
-		CYCLES += instruction_table[BYTE0 = READ_8(PC)](object);
+#		ifdef CPU_Z80_WITH_THREADED_DISPATCH
+			THREADED_DISPATCH(threaded_table, BYTE0 = CODE_8(PC));
+
+			THREADED_INSTRUCTIONS	(THREADED_INSTRUCTION	)
+			THREADED_INSTRUCTIONS_CB(THREADED_INSTRUCTION	)
+			THREADED_INSTRUCTIONS_ED(THREADED_INSTRUCTION	)
+			THREADED_INSTRUCTIONS_XY(THREADED_INSTRUCTION_XY)
+			THREADED_INSTRUCTIONS_SUPER(THREADED_INSTRUCTION)
+
+			threaded_CB:
+			R++;
+			THREADED_DISPATCH(threaded_table_CB, BYTE1 = CODE_8((PC += 2) - 1));
+
+			threaded_ED:
+			R++;
+			THREADED_DISPATCH(threaded_table_ED, BYTE1 = CODE_8(PC + 1));
+
+			threaded_DD:
+			XY = IX; iy = FALSE; R++;
+			THREADED_DISPATCH(threaded_table_XY, BYTE1 = CODE_8(PC + 1));
+
+			threaded_FD:
+			XY = IY; iy = TRUE; R++;
+			THREADED_DISPATCH(threaded_table_XY, BYTE1 = CODE_8(PC + 1));
+
+			threaded_XY_CB:
+			PC += 4;
+			BYTE2 = CODE_8(PC - 2);
+			THREADED_DISPATCH(threaded_table_XY_CB, BYTE3 = CODE_8(PC - 1));
+#		else
+			ADD_CYCLES(instruction_table_fused[BYTE0 = CODE_8(PC)](object))
+#		endif
 		}
 
+#	ifdef CPU_Z80_WITH_LAZY_FLAGS
+		/*----------------------.
+		| Compute pending flags |
+		'----------------------*/
+		flags(object);
+#	endif
+
 	/*---------------.
 	| Restore R7 bit |
 	'---------------*/
 	R = R_ALL;
 
+#	ifdef CPU_Z80_WITH_TRACE
+		/*-------------------------------.
+		| Advance the clock of the trace |
+		'-------------------------------*/
+		object->trace_clock += CYCLES;
+#	endif
+
 	/*-----------------------.
 	| Return consumed cycles |
 	'-----------------------*/
@@ -1604,11 +2567,290 @@ CPU_Z80_API void z80_nmi(Z80 *object)		      {NMI = TRUE ;}
 CPU_Z80_API void z80_int(Z80 *object, zboolean state) {INT = state;}
 
 
+#ifdef CPU_Z80_WITH_LAZY_FLAGS
+	CPU_Z80_API void z80_update_flags(Z80 *object) {flags(object);}
+#endif
+
+
+#ifdef CPU_Z80_WITH_TRACE
+
+	CPU_Z80_API void z80_trace(Z80 *object, zuint8 type, zuint16 address, zuint8 value)
+		{
+		Z80TraceRecord *record;
+
+		if (object->trace == NULL) return;
+
+		/* The bytes of the instruction being executed go in its record. */
+		if (type == Z80_TRACE_READ && object->fetching)
+			{
+			zuint16 index = (zuint16)(address - object->trace_pc);
+
+			if (index < 4)
+				{
+				object->trace_fetched[index] = value;
+				object->trace_fetched_mask |= 1U << index;
+				}
+
+			return;
+			}
+
+		if ((record = trace_record(object, type, address, object->trace_clock + CYCLES)) == NULL) return;
+		record->size	= 1;
+		record->data[0] = value;
+		}
+
+#endif
+
+
+#ifdef CPU_Z80_WITH_COVERAGE
+
+	CPU_Z80_API void z80_cover_read(Z80 *object, zuint16 address)
+		{
+		if (object->coverage != NULL)
+			object->coverage->data[address >> 3] |= 1 << (address & 7);
+		}
+
+#endif
+
+
+/* MARK: - Disassembler
+
+   Optional. The opcode tables above are expanded once more with the name
+   of each handler pasted into a form number, so an instruction decodes to
+   the handler that z80_run would call. Each form knows its size, where its
+   operand is and a template, whose uppercase letters are replaced by the
+   registers and values encoded in the opcode when it is formatted:
+
+   B  8-bit operand	       R  RST target
+   A  16-bit operand	       O  relative jump target
+   X  register in bits 5-3     P  same, IXH/IXL/IYH/IYL instead of H/L
+   Y  register in bits 2-0     Q  same, IXH/IXL/IYH/IYL instead of H/L
+   S  BC/DE/HL/SP in bits 5-4  T  BC/DE/HL/AF in bits 5-4
+   W  BC/DE/IX/SP in bits 5-4  I  IX or IY
+   C  condition in bits 5-3    J  JR condition in bits 4-3
+   U  ALU operation	       V  INC or DEC
+   G  rotation or shift	       M  RES or SET
+   N  bit number	       D  signed displacement
+   Z  the prefix byte */
+
+#ifdef CPU_Z80_WITH_DISASSEMBLER
+
+	typedef struct {
+		zuint8	    size;
+		zuint8	    operand_kind;
+		zuint8	    offset;
+		zchar const *text;
+	} DisassemblyForm;
+
+#	define DISASSEMBLY_FORMS(_)																\
+		/* Prefixes and unprefixed */															\
+		_(CB,		  1, NONE, 0, "")		_(ED,		  1, NONE, 0, "")	     _(DD,	       1, NONE, 0, "")		\
+		_(FD,		  1, NONE, 0, "")		_(XY_CB,	  1, NONE, 0, "")	     _(nop,	       1, NONE, 0, "nop")	\
+		_(ld_SS_WORD,	  3, WORD, 0, "ld S,A")		_(ld_vbc_a,	  1, NONE, 0, "ld (bc),a")   _(inc_SS,	       1, NONE, 0, "inc S")	\
+		_(V_X,		  1, NONE, 0, "V X")		_(ld_X_BYTE,	  2, BYTE, 0, "ld X,B")	     _(rlca,	       1, NONE, 0, "rlca")	\
+		_(ex_af_af_,	  1, NONE, 0, "ex af,af'")	_(add_hl_SS,	  1, NONE, 0, "add hl,S")    _(ld_a_vbc,       1, NONE, 0, "ld a,(bc)")	\
+		_(dec_SS,	  1, NONE, 0, "dec S")		_(rrca,		  1, NONE, 0, "rrca")	     _(djnz_OFFSET,    2, JUMP, 0, "djnz O")	\
+		_(ld_vde_a,	  1, NONE, 0, "ld (de),a")	_(rla,		  1, NONE, 0, "rla")	     _(jr_OFFSET,      2, JUMP, 0, "jr O")	\
+		_(ld_a_vde,	  1, NONE, 0, "ld a,(de)")	_(rra,		  1, NONE, 0, "rra")	     _(jr_Z_OFFSET,    2, JUMP, 0, "jr J,O")	\
+		_(ld_vWORD_hl,	  3, WORD, 0, "ld (A),hl")	_(daa,		  1, NONE, 0, "daa")	     _(ld_hl_vWORD,    3, WORD, 0, "ld hl,(A)")	\
+		_(cpl,		  1, NONE, 0, "cpl")		_(ld_vWORD_a,	  3, WORD, 0, "ld (A),a")    _(V_vhl,	       1, NONE, 0, "V (hl)")	\
+		_(ld_vhl_BYTE,	  2, BYTE, 0, "ld (hl),B")	_(scf,		  1, NONE, 0, "scf")	     _(ld_a_vWORD,     3, WORD, 0, "ld a,(A)")	\
+		_(ccf,		  1, NONE, 0, "ccf")		_(ld_X_Y,	  1, NONE, 0, "ld X,Y")	     _(ld_X_vhl,       1, NONE, 0, "ld X,(hl)")	\
+		_(ld_vhl_Y,	  1, NONE, 0, "ld (hl),Y")	_(halt,		  1, NONE, 0, "halt")	     _(U_a_Y,	       1, NONE, 0, "UY")	\
+		_(U_a_vhl,	  1, NONE, 0, "U(hl)")		_(ret_Z,	  1, NONE, 0, "ret C")	     _(pop_TT,	       1, NONE, 0, "pop T")	\
+		_(jp_Z_WORD,	  3, WORD, 0, "jp C,A")		_(jp_WORD,	  3, WORD, 0, "jp A")	     _(call_Z_WORD,    3, WORD, 0, "call C,A")	\
+		_(push_TT,	  1, NONE, 0, "push T")		_(U_a_BYTE,	  2, BYTE, 0, "UB")	     _(rst_N,	       1, RST,	0, "rst R")	\
+		_(ret,		  1, NONE, 0, "ret")		_(call_WORD,	  3, WORD, 0, "call A")	     _(out_vBYTE_a,    2, BYTE, 0, "out (B),a")	\
+		_(exx,		  1, NONE, 0, "exx")		_(in_a_BYTE,	  2, BYTE, 0, "in a,(B)")    _(ex_vsp_hl,      1, NONE, 0, "ex (sp),hl") \
+		_(jp_hl,	  1, NONE, 0, "jp (hl)")	_(ex_de_hl,	  1, NONE, 0, "ex de,hl")    _(di,	       1, NONE, 0, "di")	\
+		_(ld_sp_hl,	  1, NONE, 0, "ld sp,hl")	_(ei,		  1, NONE, 0, "ei")					\
+		/* CB */																		\
+		_(G_Y,		  2, NONE, 0, "G Y")		_(G_vhl,	  2, NONE, 0, "G (hl)")	     _(bit_N_Y,	       2, NONE, 0, "bit N,Y")	\
+		_(bit_N_vhl,	  2, NONE, 0, "bit N,(hl)")	_(M_N_Y,	  2, NONE, 0, "M N,Y")	     _(M_N_vhl,	       2, NONE, 0, "M N,(hl)")	\
+		/* ED */																		\
+		_(ED_illegal,	  2, BYTE, 0, "db $ed,B")	_(in_X_vc,	  2, NONE, 0, "in X,(c)")    _(out_vc_X,       2, NONE, 0, "out (c),X")	\
+		_(sbc_hl_SS,	  2, NONE, 0, "sbc hl,S")	_(ld_vWORD_SS,	  4, WORD, 0, "ld (A),S")    _(neg,	       2, NONE, 0, "neg")	\
+		_(retn,		  2, NONE, 0, "retn")		_(im_0,		  2, NONE, 0, "im 0")	     _(ld_i_a,	       2, NONE, 0, "ld i,a")	\
+		_(adc_hl_SS,	  2, NONE, 0, "adc hl,S")	_(ld_SS_vWORD,	  4, WORD, 0, "ld S,(A)")    _(reti,	       2, NONE, 0, "reti")	\
+		_(ld_r_a,	  2, NONE, 0, "ld r,a")		_(im_1,		  2, NONE, 0, "im 1")	     _(ld_a_i,	       2, NONE, 0, "ld a,i")	\
+		_(im_2,		  2, NONE, 0, "im 2")		_(ld_a_r,	  2, NONE, 0, "ld a,r")	     _(rrd,	       2, NONE, 0, "rrd")	\
+		_(rld,		  2, NONE, 0, "rld")		_(in_0_vc,	  2, NONE, 0, "in (c)")	     _(out_vc_0,       2, NONE, 0, "out (c),0")	\
+		_(ldi,		  2, NONE, 0, "ldi")		_(cpi,		  2, NONE, 0, "cpi")	     _(ini,	       2, NONE, 0, "ini")	\
+		_(outi,		  2, NONE, 0, "outi")		_(ldd,		  2, NONE, 0, "ldd")	     _(cpd,	       2, NONE, 0, "cpd")	\
+		_(ind,		  2, NONE, 0, "ind")		_(outd,		  2, NONE, 0, "outd")	     _(ldir,	       2, NONE, 0, "ldir")	\
+		_(cpir,		  2, NONE, 0, "cpir")		_(inir,		  2, NONE, 0, "inir")	     _(otir,	       2, NONE, 0, "otir")	\
+		_(lddr,		  2, NONE, 0, "lddr")		_(cpdr,		  2, NONE, 0, "cpdr")	     _(indr,	       2, NONE, 0, "indr")	\
+		_(otdr,		  2, NONE, 0, "otdr")									\
+		/* DD and FD */																		\
+		_(XY_illegal,	  1, NONE, 0, "db Z")		_(add_XY_WW,	  2, NONE, 0, "add I,W")     _(ld_XY_WORD,     4, WORD, 0, "ld I,A")	\
+		_(ld_vWORD_XY,	  4, WORD, 0, "ld (A),I")	_(inc_XY,	  2, NONE, 0, "inc I")	     _(V_JP,	       2, NONE, 0, "V P")	\
+		_(ld_JP_BYTE,	  3, BYTE, 0, "ld P,B")		_(ld_XY_vWORD,	  4, WORD, 0, "ld I,(A)")    _(dec_XY,	       2, NONE, 0, "dec I")	\
+		_(ld_JP_KQ,	  2, NONE, 0, "ld P,Q")		_(U_a_KQ,	  2, NONE, 0, "UQ")	     _(pop_XY,	       2, NONE, 0, "pop I")	\
+		_(ex_vsp_XY,	  2, NONE, 0, "ex (sp),I")	_(push_XY,	  2, NONE, 0, "push I")	     _(jp_XY,	       2, NONE, 0, "jp (I)")	\
+		_(ld_sp_XY,	  2, NONE, 0, "ld sp,I")	_(V_vXYOFFSET,	  3, NONE, 1, "V (ID)")	     _(ld_X_vXYOFFSET, 3, NONE, 1, "ld X,(ID)")	\
+		_(ld_vXYOFFSET_BYTE, 4, BYTE, 1, "ld (ID),B")	_(ld_vXYOFFSET_Y, 3, NONE, 1, "ld (ID),Y")   _(U_a_vXYOFFSET,  3, NONE, 1, "U(ID)")	\
+		/* DD CB and FD CB */																	\
+		_(G_vXYOFFSET_Y,  4, NONE, 1, "G (ID),Y")	_(G_vXYOFFSET,	  4, NONE, 1, "G (ID)")					\
+		_(bit_N_vXYOFFSET, 4, NONE, 1, "bit N,(ID)")	_(M_N_vXYOFFSET_Y, 4, NONE, 1, "M N,(ID),Y") _(M_N_vXYOFFSET,  4, NONE, 1, "M N,(ID)")
+
+#	define DISASSEMBLY_ENUM(function, size, operand_kind, offset, text) DISASSEMBLY_##function,
+#	define DISASSEMBLY_FORM(function, size, operand_kind, offset, text) {size, Z80_OPERAND_##operand_kind, offset, text},
+
+	enum {DISASSEMBLY_FORMS(DISASSEMBLY_ENUM)};
+	static DisassemblyForm const disassembly_forms[] = {DISASSEMBLY_FORMS(DISASSEMBLY_FORM)};
+
+	/* Two steps, so that the SUPER cells are expanded before pasting. The
+	   superinstructions decode as their first instruction. */
+#	undef SUPER
+#	define SUPER(opcode) UNFUSED_##opcode
+#	define DISASSEMBLY_CELL(function) DISASSEMBLY_CELL_EXPANDED(function)
+#	define DISASSEMBLY_CELL_EXPANDED(function) DISASSEMBLY_##function
+
+	static zuint8 const disassembly_table	   [256] = {INSTRUCTION_TABLE	   (DISASSEMBLY_CELL)};
+	static zuint8 const disassembly_table_CB   [256] = {INSTRUCTION_TABLE_CB   (DISASSEMBLY_CELL)};
+	static zuint8 const disassembly_table_ED   [256] = {INSTRUCTION_TABLE_ED   (DISASSEMBLY_CELL)};
+	static zuint8 const disassembly_table_XY   [256] = {INSTRUCTION_TABLE_XY   (DISASSEMBLY_CELL)};
+	static zuint8 const disassembly_table_XY_CB[256] = {INSTRUCTION_TABLE_XY_CB(DISASSEMBLY_CELL)};
+
+	static zchar const *const disassembly_registers[3][8] = {
+		{"b", "c", "d", "e", "h",   "l",   "(hl)", "a"},
+		{"b", "c", "d", "e", "ixh", "ixl", "(ix)", "a"},
+		{"b", "c", "d", "e", "iyh", "iyl", "(iy)", "a"}};
+
+	static zchar const *const disassembly_pairs[4][4] = {
+		{"bc", "de", "hl", "sp"},
+		{"bc", "de", "hl", "af"},
+		{"bc", "de", "ix", "sp"},
+		{"bc", "de", "iy", "sp"}};
+
+	static zchar const *const disassembly_conditions[8] = {"nz", "z", "nc", "c", "po", "pe", "p", "m"};
+	static zchar const *const disassembly_alu[8] = {"add a,", "adc a,", "sub ", "sbc a,", "and ", "xor ", "or ", "cp "};
+	static zchar const *const disassembly_rotations[8] = {"rlc", "rrc", "rl", "rr", "sla", "sra", "sll", "srl"};
+	static zchar const disassembly_hex[] = "0123456789abcdef";
+
+
+	CPU_Z80_API zuint8 z80_disassemble(zuint16 address, zuint8 const *bytes, Z80Disassembly *instruction)
+		{
+		zuint8 form = disassembly_table[bytes[0]];
+		DisassemblyForm const *f;
+
+		if	(form == DISASSEMBLY_CB) form = disassembly_table_CB[bytes[1]];
+		else if (form == DISASSEMBLY_ED) form = disassembly_table_ED[bytes[1]];
+
+		else if ((form == DISASSEMBLY_DD || form == DISASSEMBLY_FD) &&
+			 (form = disassembly_table_XY[bytes[1]]) == DISASSEMBLY_XY_CB
+		)
+			form = disassembly_table_XY_CB[bytes[3]];
+
+		f = &disassembly_forms[form];
+		instruction->address	  = address;
+		instruction->size	  = f->size;
+		instruction->form	  = form;
+		instruction->operand_kind = f->operand_kind;
+		instruction->offset	  = f->offset ? (zsint8)bytes[2] : 0;
+		instruction->bytes[0]	  = bytes[0];
+		instruction->bytes[1]	  = bytes[1];
+		instruction->bytes[2]	  = bytes[2];
+		instruction->bytes[3]	  = bytes[3];
+
+		switch (f->operand_kind)
+			{
+			case Z80_OPERAND_BYTE: instruction->operand = bytes[f->size - 1];				      break;
+			case Z80_OPERAND_WORD: instruction->operand = bytes[f->size - 2] | (zuint16)bytes[f->size - 1] << 8; break;
+			case Z80_OPERAND_JUMP: instruction->operand = (zuint16)(address + 2 + (zsint8)bytes[1]);	      break;
+			case Z80_OPERAND_RST:  instruction->operand = bytes[0] & 0x38;					      break;
+			default:	       instruction->operand = 0;
+			}
+
+		return f->size;
+		}
+
+
+	static zchar *disassembly_hex_8(zchar *p, zuint8 value)
+		{
+		*p++ = '$';
+		*p++ = disassembly_hex[value >> 4];
+		*p++ = disassembly_hex[value & 15];
+		return p;
+		}
+
+
+	static zchar *disassembly_copy(zchar *p, zchar const *text)
+		{
+		while (*text) *p++ = *text++;
+		return p;
+		}
+
+
+	CPU_Z80_API zusize z80_disassembly_format(Z80Disassembly const *instruction, zchar *text)
+		{
+		zuint8 const *bytes = instruction->bytes;
+		zchar const *t = disassembly_forms[instruction->form].text;
+		zchar *p = text;
+		zuint8 xy = 0, opcode = bytes[0];
+
+		/* The opcode is the byte that indexed the last table. */
+		if (opcode == 0xDD || opcode == 0xFD)
+			{
+			xy = opcode == 0xDD ? 1 : 2;
+			opcode = bytes[1] == 0xCB ? bytes[3] : bytes[1];
+			}
+
+		else if (opcode == 0xCB || opcode == 0xED) opcode = bytes[1];
+
+		for (; *t; t++) switch (*t)
+			{
+			case 'B': p = disassembly_hex_8(p, (zuint8)instruction->operand); break;
+
+			case 'A': case 'O':
+			p = disassembly_hex_8(p, (zuint8)(instruction->operand >> 8));
+			*p++ = disassembly_hex[(instruction->operand >> 4) & 15];
+			*p++ = disassembly_hex[instruction->operand & 15];
+			break;
+
+			case 'R': p = disassembly_hex_8(p, (zuint8)instruction->operand); break;
+			case 'X': p = disassembly_copy(p, disassembly_registers[0][(opcode >> 3) & 7]); break;
+			case 'Y': p = disassembly_copy(p, disassembly_registers[0][opcode & 7]); break;
+			case 'P': p = disassembly_copy(p, disassembly_registers[xy][(opcode >> 3) & 7]); break;
+			case 'Q': p = disassembly_copy(p, disassembly_registers[xy][opcode & 7]); break;
+			case 'S': p = disassembly_copy(p, disassembly_pairs[0][(opcode >> 4) & 3]); break;
+			case 'T': p = disassembly_copy(p, disassembly_pairs[1][(opcode >> 4) & 3]); break;
+			case 'W': p = disassembly_copy(p, disassembly_pairs[1 + xy][(opcode >> 4) & 3]); break;
+			case 'I': *p++ = 'i'; *p++ = xy == 1 ? 'x' : 'y'; break;
+			case 'C': p = disassembly_copy(p, disassembly_conditions[(opcode >> 3) & 7]); break;
+			case 'J': p = disassembly_copy(p, disassembly_conditions[(opcode >> 3) & 3]); break;
+			case 'U': p = disassembly_copy(p, disassembly_alu[(opcode >> 3) & 7]); break;
+			case 'V': p = disassembly_copy(p, opcode & 1 ? "dec" : "inc"); break;
+			case 'G': p = disassembly_copy(p, disassembly_rotations[(opcode >> 3) & 7]); break;
+			case 'M': p = disassembly_copy(p, opcode & 0x40 ? "set" : "res"); break;
+			case 'N': *p++ = (zchar)('0' + ((opcode >> 3) & 7)); break;
+
+			case 'D':
+			*p++ = instruction->offset < 0 ? '-' : '+';
+			p = disassembly_hex_8(p, (zuint8)(instruction->offset < 0 ? -instruction->offset : instruction->offset));
+			break;
+
+			case 'Z': p = disassembly_hex_8(p, bytes[0]); break;
+			default:  *p++ = *t;
+			}
+
+		*p = 0;
+		return (zusize)(p - text);
+		}
+
+#endif
+
+
 /* MARK: - ABI */
 
 #ifdef CPU_Z80_WITH_ABI
 
-	static void will_read_state(Z80 *object) {R  = R_ALL;}
+#	ifdef CPU_Z80_WITH_LAZY_FLAGS
+		static void will_read_state(Z80 *object) {R = R_ALL; flags(object);}
+#	else
+		static void will_read_state(Z80 *object) {R = R_ALL;}
+#	endif
+
 	static void did_write_state(Z80 *object) {R7 = R;    }
 
 	static ZCPUEmulatorExport const exports[7] = {
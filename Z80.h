@@ -27,6 +27,155 @@ this emulator. If not, see <http://www.gnu.org/licenses/>.
 #	include <Z/hardware/CPU/architecture/Z80.h>
 #endif
 
+#ifdef CPU_Z80_WITH_HISTOGRAM
+
+	/** Indices of the opcode tables in @c Z80Histogram. */
+
+#	define Z80_HISTOGRAM_TABLE	 0 /* Unprefixed opcodes.	  */
+#	define Z80_HISTOGRAM_TABLE_CB	 1 /* Opcodes after @c CBh.	  */
+#	define Z80_HISTOGRAM_TABLE_ED	 2 /* Opcodes after @c EDh.	  */
+#	define Z80_HISTOGRAM_TABLE_XY	 3 /* Opcodes after @c DDh or @c FDh. */
+#	define Z80_HISTOGRAM_TABLE_XY_CB 4 /* Opcodes after @c DDh/FDh @c CBh and the offset. */
+
+	/** Execution counters filled in by @c z80_run.
+	  * @details Each executed instruction adds 1 to @c count and the cycles
+	  * it took (prefixes included) to @c cycles, under its table and last
+	  * opcode byte. An instruction with an ignored @c DDh or @c FDh prefix
+	  * is counted as the unprefixed instruction. Each iteration of a block
+	  * repeat instruction and each execution of @c HALT is counted, and
+	  * while counting, @c z80_run neither runs translated blocks nor skips
+	  * idle loops, so the cycles of all the instructions and interrupts add
+	  * up to the cycles run. */
+
+	typedef struct {
+		zuint64 count [5][256];
+		zuint64 cycles[5][256];
+
+		/** Accepted maskable interrupts, per interrupt mode. */
+
+		zuint64 int_count[3];
+
+		/** Accepted non-maskable interrupts. */
+
+		zuint64 nmi_count;
+
+		/** Cycles taken to accept all of the interrupts. */
+
+		zuint64 interrupt_cycles;
+	} Z80Histogram;
+
+#endif
+
+#ifdef CPU_Z80_WITH_CALL_HOOKS
+
+	/** Kinds of subroutine entry passed to the @c call callback. */
+
+#	define Z80_CALL_INSTRUCTION 0 /* @c CALL or a taken conditional @c CALL. */
+#	define Z80_CALL_RST	    1 /* @c RST instruction.			  */
+#	define Z80_CALL_INT	    2 /* Maskable interrupt, in any mode.	  */
+#	define Z80_CALL_NMI	    3 /* Non-maskable interrupt.		  */
+
+#endif
+
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+
+	/** Conditions in @c stops, and reasons passed to the @c breakpoint
+	  * callback. */
+
+#	define Z80_STOP_BREAKPOINTS  1 /* PC is set in @c breakpoints.	   */
+#	define Z80_STOP_INSTRUCTIONS 2 /* @c instructions_left reached zero. */
+#	define Z80_STOP_CHECK	     4 /* The @c check callback returned TRUE. */
+
+#endif
+
+#ifdef CPU_Z80_WITH_TRACE
+
+	/** Types of @c Z80TraceRecord.
+	  * @details The access records of an instruction precede its
+	  * instruction record, and its register records follow it. */
+
+#	define Z80_TRACE_INSTRUCTION 0 /* Executed instruction: PC and opcode bytes.	 */
+#	define Z80_TRACE_REGISTER    1 /* Register changed by the instruction before.	 */
+#	define Z80_TRACE_INTERRUPT   2 /* Accepted INT: handler address and mode.	 */
+#	define Z80_TRACE_NMI	     3 /* Accepted NMI: handler address.		 */
+#	define Z80_TRACE_READ	     4 /* Memory read: address and value.		 */
+#	define Z80_TRACE_WRITE	     5 /* Memory write: address and value.		 */
+#	define Z80_TRACE_IN	     6 /* Port read: port and value.			 */
+#	define Z80_TRACE_OUT	     7 /* Port write: port and value.			 */
+
+	/** Registers of the @c Z80_TRACE_REGISTER records, in @c address. */
+
+#	define Z80_TRACE_AF	  0
+#	define Z80_TRACE_BC	  1
+#	define Z80_TRACE_DE	  2
+#	define Z80_TRACE_HL	  3
+#	define Z80_TRACE_IX	  4
+#	define Z80_TRACE_IY	  5
+#	define Z80_TRACE_SP	  6
+#	define Z80_TRACE_AF_	  7
+#	define Z80_TRACE_BC_	  8
+#	define Z80_TRACE_DE_	  9
+#	define Z80_TRACE_HL_	 10
+#	define Z80_TRACE_REGISTERS 11
+
+	/** One entry of the execution trace. */
+
+	typedef struct {
+		zuint64 cycle;	 /* Cycle at which it happened, see @c trace_clock.	  */
+		zuint16 address; /* PC, handler, memory address, port or register.	  */
+		zuint8	type;	 /* One of the @c Z80_TRACE_* types.			  */
+		zuint8	size;	 /* Bytes used in @c data.				  */
+		zuint8	data[4]; /* Instruction bytes, interrupt mode, or value.	  */
+	} Z80TraceRecord;
+
+#endif
+
+#ifdef CPU_Z80_WITH_COVERAGE
+
+	/** Addresses reached by the CPU, one bit per address (bit
+	  * <tt>address & 7</tt> of byte <tt>address >> 3</tt>). */
+
+	typedef struct {
+		/** First bytes of executed instructions, set by @c z80_run. */
+
+		zuint8 executed[8192];
+
+		/** Bytes read as data, set by @c z80_cover_read. */
+
+		zuint8 data[8192];
+	} Z80Coverage;
+
+#endif
+
+#ifdef CPU_Z80_WITH_DISASSEMBLER
+
+	/** Maximum length of the text of a disassembled instruction, including
+	  * the terminating null character. */
+
+#	define Z80_DISASSEMBLY_TEXT_SIZE 24
+
+	/** Kinds of @c operand of a @c Z80Disassembly. */
+
+#	define Z80_OPERAND_NONE 0 /* No operand.				    */
+#	define Z80_OPERAND_BYTE 1 /* 8-bit immediate value or port.	    */
+#	define Z80_OPERAND_WORD 2 /* 16-bit immediate value or address.	    */
+#	define Z80_OPERAND_JUMP 3 /* Target of a relative jump.		    */
+#	define Z80_OPERAND_RST	4 /* Target of an @c RST instruction.	    */
+
+	/** Instruction decoded by @c z80_disassemble. */
+
+	typedef struct {
+		zuint16 address;      /* Address of its first byte.			     */
+		zuint16 operand;      /* Value of its operand, see @c operand_kind.	     */
+		zuint8	bytes[4];     /* Bytes read; only the first @c size belong to it.  */
+		zuint8	size;	      /* Length in bytes, 1 to 4.			     */
+		zuint8	form;	      /* Handler that executes it, used by the formatter.  */
+		zuint8	operand_kind; /* One of the @c Z80_OPERAND_* kinds.		     */
+		zsint8	offset;	      /* Displacement of @c (IX+d) or @c (IY+d), or 0.	     */
+	} Z80Disassembly;
+
+#endif
+
 /** Z80 emulator instance.
   * @details This structure contains the state of the emulated CPU and callback
   * pointers necessary to interconnect the emulator with external logic. There
@@ -44,6 +193,14 @@ typedef struct {
 
 	zusize cycles;
 
+	/** Number of cycles to be executed in the current call to @c z80_run.
+	  * @details @c z80_run sets this variable to its @p cycles argument
+	  * and returns at the first instruction boundary where @c cycles
+	  * reaches it. The callbacks can lower it to make @c z80_run return
+	  * earlier. */
+
+	zusize cycle_limit;
+
 	/** The value used as the first argument when calling a callback.
 	  * @details This variable should be initialized before using the
 	  * emulator and can be used to reference the context/instance of
@@ -127,6 +284,263 @@ typedef struct {
 	  * @details This is an internal private variable. */
 
 	Z32Bit data;
+
+#	ifdef CPU_Z80_WITH_LAZY_FLAGS
+
+		/** Pending flag computation.
+		  * @details This is an internal private variable. It holds the
+		  * 8-bit arithmetic or logical operation (plus 1) whose flags have
+		  * not been computed yet, or 0 if F is up to date. */
+
+		zuint8 flags_operation;
+
+		/** Operands of the pending flag computation (A, value and carry).
+		  * @details This is an internal private variable. */
+
+		zuint8 flags_operands[3];
+
+#	endif
+
+#	ifdef CPU_Z80_WITH_MEMORY_MAP
+
+		/** Direct read access to memory, one pointer per 256-byte page.
+		  * @details If the entry of a page is not @c NULL, the CPU reads
+		  * that page from the buffer it points to instead of calling
+		  * @c read. Pages left as @c NULL (unmapped memory or devices)
+		  * keep going through the callback. */
+
+		zuint8 const *read_map[256];
+
+		/** Direct write access to memory, one pointer per 256-byte page.
+		  * @details Same as @c read_map, but for writes. A page mapped for
+		  * reading only (ROM) must be left as @c NULL here, so that its
+		  * writes are passed to @c write. */
+
+		zuint8 *write_map[256];
+
+#	endif
+
+#	ifdef CPU_Z80_WITH_IDLE_LOOPS
+
+		/** Callback: Called when an idle loop is skipped.
+		  * @param context The value of the member @c context.
+		  * @param address The address of the first instruction of the loop.
+		  * @param cycles The number of cycles skipped.
+		  * @note This callback is optional and must be set to @c NULL if not
+		  * used. */
+
+		void (* idle)(void *context, zuint16 address, zusize cycles);
+
+		/** Ports whose reads have no side effects, one bit per port.
+		  * @details Only the low byte of the port number is used (bit
+		  * <tt>port & 7</tt> of byte <tt>port >> 3</tt>). A loop that reads
+		  * any other port is never considered idle. */
+
+		zuint8 idempotent_ports[32];
+
+		/** State of the CPU at the last arrival at the head of a loop.
+		  * @details This is an internal private variable. */
+
+		ZZ80State idle_state;
+
+		/** Cycle count at the last arrival at the head of a loop.
+		  * @details This is an internal private variable. */
+
+		zusize idle_cycles;
+
+		/** @c TRUE if the CPU has not written to memory, performed output
+		  * or read a port with side effects since the last arrival at the
+		  * head of a loop.
+		  * @details This is an internal private variable. */
+
+		zboolean idle_clean;
+
+#	endif
+
+#	ifdef CPU_Z80_WITH_HISTOGRAM
+
+		/** Execution counters.
+		  * @details It must be set to @c NULL or point to a zeroed
+		  * @c Z80Histogram, which @c z80_run then keeps adding to. */
+
+		Z80Histogram *histogram;
+
+#	endif
+
+#	ifdef CPU_Z80_WITH_CALL_HOOKS
+
+		/** Callback: Called when a subroutine is entered.
+		  * @param context The value of the member @c context.
+		  * @param address The address of the subroutine.
+		  * @param kind One of the @c Z80_CALL_* constants.
+		  * @details It is called once the return address has been pushed
+		  * and PC points to the subroutine, before the cycles of the
+		  * instruction or interrupt acceptance are added.
+		  * @note This callback is optional and must be set to @c NULL if not
+		  * used. */
+
+		void (* call)(void *context, zuint16 address, zuint8 kind);
+
+		/** Callback: Called when @c RET, a taken conditional @c RET,
+		  * @c RETI or @c RETN has popped the return address.
+		  * @param context The value of the member @c context.
+		  * @note This callback is optional and must be set to @c NULL if not
+		  * used. */
+
+		void (* ret)(void *context);
+
+		/** Callback: Called when an instruction loads SP with a new value
+		  * (<tt>LD SP,nn</tt>, <tt>LD SP,(nn)</tt>, <tt>LD SP,HL</tt>,
+		  * <tt>LD SP,IX</tt> or <tt>LD SP,IY</tt>), which can discard the
+		  * frames of the subroutines being executed.
+		  * @param context The value of the member @c context.
+		  * @note This callback is optional and must be set to @c NULL if not
+		  * used. */
+
+		void (* sp_load)(void *context);
+
+#	endif
+
+#	ifdef CPU_Z80_WITH_TRACE
+
+		/** Where the next trace record is written.
+		  * @details Tracing is off while it is @c NULL. */
+
+		Z80TraceRecord *trace;
+
+		/** End of the buffer that @c trace points into. */
+
+		Z80TraceRecord *trace_end;
+
+		/** Callback: Called when the trace buffer is full.
+		  * @param context The value of the member @c trace_context.
+		  * @details It must point @c trace and @c trace_end to a buffer with
+		  * room for at least one record, or set @c trace to @c NULL to stop
+		  * tracing. */
+
+		void (* trace_full)(void *context);
+
+		/** Value passed to @c trace_full. */
+
+		void *trace_context;
+
+		/** @c TRUE to add a register record for each register that an
+		  * instruction changes. */
+
+		zboolean trace_registers;
+
+		/** Cycles run by the previous calls to @c z80_run.
+		  * @details The cycle of a record is this plus the cycles run by the
+		  * current call. The host can set it to start counting from any
+		  * value. */
+
+		zuint64 trace_clock;
+
+		/** Register values of the last register records, in
+		  * @c Z80_TRACE_* order.
+		  * @details The host must zero them when it starts a new trace, so
+		  * that the records of the trace can be applied from zero. */
+
+		zuint16 trace_values[Z80_TRACE_REGISTERS];
+
+		/** PC and cycle at the start of the instruction being executed, and
+		  * the operands fetched by it.
+		  * @details These are internal private variables. */
+
+		zuint16 trace_pc;
+		zusize	trace_start;
+		zuint8	trace_fetched[4];
+		zuint8	trace_fetched_mask;
+
+#	endif
+
+#	ifdef CPU_Z80_WITH_COVERAGE
+
+		/** Coverage bitmaps.
+		  * @details It must be set to @c NULL or point to a
+		  * @c Z80Coverage, whose bits @c z80_run then keeps setting. */
+
+		Z80Coverage *coverage;
+
+#	endif
+
+#	if defined(CPU_Z80_WITH_TRACE) || defined(CPU_Z80_WITH_COVERAGE)
+
+		/** Whether the read in progress fetches a byte of the instruction
+		  * being executed.
+		  * @details @c z80_run sets it around the reads of opcodes and
+		  * operands, so that the @c read callback can tell them from data
+		  * reads. It must not be changed. */
+
+		zboolean fetching;
+
+#	endif
+
+#	ifdef CPU_Z80_WITH_BREAKPOINTS
+
+		/** Conditions checked before each instruction, any of the
+		  * @c Z80_STOP_* bits.
+		  * @details They are in one word so that, while it is zero, the
+		  * check is a single branch. While it is not zero, every instruction
+		  * goes through @c z80_run: the superinstructions, the chaining of
+		  * threaded dispatch and the skipping of idle loops are bypassed. */
+
+		zuint8 stops;
+
+		/** Execution breakpoints, one bit per address (bit
+		  * <tt>address & 7</tt> of byte <tt>address >> 3</tt>).
+		  * @details It must point to 8192 bytes while @c stops has
+		  * @c Z80_STOP_BREAKPOINTS. */
+
+		zuint8 const *breakpoints;
+
+		/** Instructions to execute before stopping, while @c stops has
+		  * @c Z80_STOP_INSTRUCTIONS.
+		  * @details Each instruction executed decrements it, and accepting
+		  * an interrupt does not. When it is zero before an instruction,
+		  * @c z80_run clears @c Z80_STOP_INSTRUCTIONS and calls back. A
+		  * @c HALT waiting for an interrupt counts once per call to
+		  * @c z80_run. */
+
+		zuint64 instructions_left;
+
+		/** Callback: Called before each instruction while @c stops has
+		  * @c Z80_STOP_CHECK.
+		  * @details F is up to date when it is called, even with lazy
+		  * flags.
+		  * @param context The value of the member @c context.
+		  * @param address The address of the instruction.
+		  * @return @c TRUE to call @c breakpoint there. */
+
+		zboolean (* check)(void *context, zuint16 address);
+
+		/** Callback: Called before executing an instruction, or before
+		  * accepting an interrupt, where a condition of @c stops is met.
+		  * @details To stop there, it lowers @c cycle_limit to @c cycles.
+		  * The next call to @c z80_run then starts with that instruction
+		  * without checking the conditions again.
+		  * @param context The value of the member @c context.
+		  * @param address The address of the instruction.
+		  * @param reasons The @c Z80_STOP_* bits of the conditions met.
+		  * @note This callback is optional and must be set to @c NULL if not
+		  * used. */
+
+		void (* breakpoint)(void *context, zuint16 address, zuint8 reasons);
+
+		/** Address of the instruction being executed, kept while
+		  * @c stops is not zero, e.g. for the callbacks to report the
+		  * instruction that accessed a watched address. */
+
+		zuint16 break_pc;
+
+		/** @c TRUE after @c z80_run has stopped where a condition of
+		  * @c stops was met.
+		  * @details Set it to @c FALSE after changing PC to check the
+		  * conditions at the new address too. */
+
+		zboolean breakpoint_hit;
+
+#	endif
 } Z80;
 
 Z_C_SYMBOLS_BEGIN
@@ -174,6 +588,77 @@ CPU_Z80_API void z80_nmi(Z80 *object);
 
 CPU_Z80_API void z80_int(Z80 *object, zboolean state);
 
+#ifdef CPU_Z80_WITH_LAZY_FLAGS
+
+	/** Computes the pending flags.
+	  * @details With lazy flags, the F register may be out of date while
+	  * @c z80_run is executing. Callbacks that inspect it must call this
+	  * function first. @c z80_run always updates F before returning.
+	  * @param object A pointer to a Z80 emulator instance. */
+
+	CPU_Z80_API void z80_update_flags(Z80 *object);
+
+#endif
+
+#ifdef CPU_Z80_WITH_TRACE
+
+	/** Adds a memory or I/O access record to the trace.
+	  * @details It is meant to be called from the bus callbacks, and does
+	  * nothing while tracing is off. The fetches of the instruction being
+	  * executed are not recorded as reads; their bytes go in the record of
+	  * the instruction.
+	  * @param object A pointer to a Z80 emulator instance.
+	  * @param type @c Z80_TRACE_READ, @c Z80_TRACE_WRITE, @c Z80_TRACE_IN
+	  * or @c Z80_TRACE_OUT.
+	  * @param address The memory address or the port.
+	  * @param value The value read or written. */
+
+	CPU_Z80_API void z80_trace(Z80 *object, zuint8 type, zuint16 address, zuint8 value);
+
+#endif
+
+#ifdef CPU_Z80_WITH_COVERAGE
+
+	/** Marks a memory read as a data read in the coverage bitmaps.
+	  * @details It is meant to be called from the @c read callback for the
+	  * reads made while @c fetching is @c FALSE, and does nothing while
+	  * @c coverage is @c NULL.
+	  * @param object A pointer to a Z80 emulator instance.
+	  * @param address The address read. */
+
+	CPU_Z80_API void z80_cover_read(Z80 *object, zuint16 address);
+
+#endif
+
+#ifdef CPU_Z80_WITH_DISASSEMBLER
+
+	/** Decodes one instruction.
+	  * @details The opcodes are looked up in the same tables that
+	  * @c z80_run uses to select the handler that executes them, so the
+	  * decoding agrees with the execution. An ignored @c DDh or @c FDh
+	  * prefix is decoded as a 1-byte instruction, and an undefined @c EDh
+	  * instruction as a 2-byte one. No memory is allocated and no text is
+	  * produced, so it is cheap enough for long traces.
+	  * @param address The address of the instruction.
+	  * @param bytes Its first 4 bytes; the ones after it are ignored.
+	  * @param instruction The decoded instruction.
+	  * @return The length of the instruction in bytes. */
+
+	CPU_Z80_API zuint8 z80_disassemble(zuint16 address, zuint8 const *bytes, Z80Disassembly *instruction);
+
+	/** Writes the text of a decoded instruction.
+	  * @details The mnemonics and registers are in lowercase and the
+	  * numbers in hexadecimal with a @c $ prefix, as in
+	  * <tt>ld (ix+$05),$3e</tt>.
+	  * @param instruction An instruction decoded by @c z80_disassemble.
+	  * @param text Where to write the null-terminated text, at least
+	  * @c Z80_DISASSEMBLY_TEXT_SIZE characters.
+	  * @return The length of the text. */
+
+	CPU_Z80_API zusize z80_disassembly_format(Z80Disassembly const *instruction, zchar *text);
+
+#endif
+
 Z_C_SYMBOLS_END
 
 #ifdef CPU_Z80_WITH_ABI
@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <string.h>
+#include "callgraph.h"
+
+#define MAX_NAME_LEN 128
+
+static int add_node(call_graph *g, int parent, uint16_t address) {
+	if (g->node_count == g->node_capacity) {
+		g->node_capacity = g->node_capacity ? g->node_capacity * 2 : 256;
+		g->nodes = realloc(g->nodes, g->node_capacity * sizeof(call_node));
+	}
+	int index = g->node_count++;
+	g->nodes[index] = (call_node){address, parent, -1, -1, 0, 0, 0};
+	if (parent >= 0) {
+		g->nodes[index].next_sibling = g->nodes[parent].first_child;
+		g->nodes[parent].first_child = index;
+	}
+	return index;
+}
+
+// The node of `address` called from `parent`, created if it is the first call
+static int child(call_graph *g, int parent, uint16_t address) {
+	for (int i = g->nodes[parent].first_child; i >= 0; i = g->nodes[i].next_sibling) {
+		if (g->nodes[i].address == address) return i;
+	}
+	return add_node(g, parent, address);
+}
+
+static int current(const call_graph *g) {
+	return g->depth ? g->stack[g->depth - 1].node : 0;
+}
+
+// Adds the cycles since the last event to the running path
+static void account(call_graph *g) {
+	uint64_t now = scheduler_now(&g->machine->events);
+	g->nodes[current(g)].self += now - g->last;
+	g->last = now;
+}
+
+#ifdef CPU_Z80_WITH_CALL_HOOKS
+
+static void unwind(call_graph *g) {
+	uint16_t sp = g->machine->cpu.state.Z_Z80_STATE_MEMBER_SP;
+	account(g);
+	while (g->depth && g->stack[g->depth - 1].sp < sp) g->depth--;
+}
+
+static void on_call(void *context, zuint16 address, zuint8 kind) {
+	call_graph *g = ((Machine *)context)->call_graph;
+	(void)kind;
+	account(g);
+	// deeper calls are added to the deepest path followed
+	if (g->depth == MAX_CALL_DEPTH) return;
+	int node = child(g, current(g), address);
+	g->nodes[node].calls++;
+	g->stack[g->depth++] = (call_frame){g->machine->cpu.state.Z_Z80_STATE_MEMBER_SP, node};
+}
+
+static void on_ret(void *context) {
+	unwind(((Machine *)context)->call_graph);
+}
+
+#endif
+
+void call_graph_init(call_graph *g) {
+	memset(g, 0, sizeof(*g));
+}
+
+void call_graph_free(call_graph *g) {
+	call_graph_detach(g);
+	free(g->nodes);
+	g->nodes = NULL;
+	g->node_count = g->node_capacity = 0;
+}
+
+bool call_graph_attach(call_graph *g, Machine *machine) {
+#ifdef CPU_Z80_WITH_CALL_HOOKS
+	call_graph_detach(g);
+	if (g->node_count == 0) add_node(g, -1, machine->cpu.state.Z_Z80_STATE_MEMBER_PC);
+	g->machine = machine;
+	g->depth = 0;
+	g->last = scheduler_now(&machine->events);
+	machine->call_graph = g;
+	machine->cpu.call = on_call;
+	machine->cpu.ret = on_ret;
+	machine->cpu.sp_load = on_ret;
+	return true;
+#else
+	(void)g;
+	(void)machine;
+	return false;
+#endif
+}
+
+void call_graph_detach(call_graph *g) {
+	if (g->machine == NULL) return;
+	account(g);
+#ifdef CPU_Z80_WITH_CALL_HOOKS
+	g->machine->cpu.call = NULL;
+	g->machine->cpu.ret = NULL;
+	g->machine->cpu.sp_load = NULL;
+#endif
+	g->machine->call_graph = NULL;
+	g->machine = NULL;
+}
+
+void call_graph_add(call_graph *g, const call_graph *from) {
+	if (from->node_count == 0) return;
+	if (g->node_count == 0) add_node(g, -1, from->nodes[0].address);
+
+	// parents are created before their children, so they are mapped first
+	int *map = malloc(from->node_count * sizeof(int));
+	map[0] = 0;
+	for (int i = 0; i < from->node_count; i++) {
+		const call_node *n = &from->nodes[i];
+		if (i) map[i] = child(g, map[n->parent], n->address);
+		g->nodes[map[i]].calls += n->calls;
+		g->nodes[map[i]].self += n->self;
+	}
+	free(map);
+}
+
+void call_graph_totals(call_graph *g) {
+	for (int i = 0; i < g->node_count; i++) {
+		g->nodes[i].total = g->nodes[i].self;
+	}
+	for (int i = g->node_count - 1; i > 0; i--) {
+		g->nodes[g->nodes[i].parent].total += g->nodes[i].total;
+	}
+}
+
+static void write_path(const call_graph *g, const symbol_table *symbols, int node, FILE *file) {
+	char name[MAX_NAME_LEN];
+	if (g->nodes[node].parent >= 0) {
+		write_path(g, symbols, g->nodes[node].parent, file);
+		fputc(';', file);
+	}
+	fputs(symbols_name(symbols, g->nodes[node].address, name, sizeof(name)), file);
+}
+
+static const call_graph *sorted_graph;
+
+static int compare_totals(const void *a, const void *b) {
+	const call_node *x = &sorted_graph->nodes[*(const int *)a], *y = &sorted_graph->nodes[*(const int *)b];
+	if (x->total != y->total) return x->total > y->total ? -1 : 1;
+	return *(const int *)a - *(const int *)b;
+}
+
+void call_graph_report(const call_graph *g, const symbol_table *symbols, FILE *file, int lines) {
+	uint64_t cycles = g->node_count ? g->nodes[0].total : 0;
+	int *order = malloc((g->node_count + 1) * sizeof(int));
+	for (int i = 0; i < g->node_count; i++) {
+		order[i] = i;
+	}
+	// qsort has no context argument; reports are written from one thread
+	sorted_graph = g;
+	qsort(order, g->node_count, sizeof(int), compare_totals);
+
+	fprintf(file, "%d call paths, %llu cycles\n\n", g->node_count, (unsigned long long)cycles);
+	fprintf(file, "  total    inclusive    exclusive      calls  path\n");
+	for (int i = 0; i < g->node_count && i < lines; i++) {
+		const call_node *n = &g->nodes[order[i]];
+		fprintf(file, "%6.2f%% %12llu %12llu %10llu  ", cycles ? 100.0 * n->total / cycles : 0,
+			(unsigned long long)n->total, (unsigned long long)n->self, (unsigned long long)n->calls);
+		write_path(g, symbols, order[i], file);
+		fputc('\n', file);
+	}
+	free(order);
+}
+
+bool call_graph_write_folded(const call_graph *g, const symbol_table *symbols, const char *path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) return false;
+	for (int i = 0; i < g->node_count; i++) {
+		if (g->nodes[i].self == 0) continue;
+		write_path(g, symbols, i, file);
+		fprintf(file, " %llu\n", (unsigned long long)g->nodes[i].self);
+	}
+	return fclose(file) == 0;
+}
@@ -0,0 +1,72 @@
+// Call graph profiler: follows the calls, RSTs and interrupts of a machine on
+// a shadow call stack and adds the emulated cycles to the call path that is
+// running, so it gives the exclusive and inclusive cycles of each path. Needs
+// Z80.c built with CPU_Z80_WITH_CALL_HOOKS.
+//
+// The shadow stack is kept in step with SP: a return, or a load of SP, drops
+// the frames whose return address is below the new SP. So a RET that jumps
+// through an address pushed by the code itself stays in the same function,
+// and a routine that drops its return address and jumps back to a caller
+// leaves the frames it skipped.
+
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+#include "symbols.h"
+
+#define MAX_CALL_DEPTH 256
+
+// A call path: the function at `address` called through the path of `parent`
+typedef struct {
+	uint16_t address;
+	int parent;  // -1 for the root
+	int first_child;
+	int next_sibling;
+	uint64_t calls;
+	uint64_t self;   // exclusive cycles
+	uint64_t total;  // inclusive cycles, set by call_graph_totals
+} call_node;
+
+typedef struct {
+	uint16_t sp;  // pointing to the return address
+	int node;
+} call_frame;
+
+typedef struct {
+	call_node *nodes;  // node 0 is the root, where the machine was attached
+	int node_count;
+	int node_capacity;
+
+	Machine *machine;  // being profiled, if any
+	call_frame stack[MAX_CALL_DEPTH];
+	int depth;
+	uint64_t last;  // cycle up to which cycles have been added
+} call_graph;
+
+void call_graph_init(call_graph *g);
+void call_graph_free(call_graph *g);
+
+// Starts following a machine from its current PC, which becomes the root if
+// the graph is empty. Only one call graph can follow a machine. Returns false
+// if Z80.c was built without CPU_Z80_WITH_CALL_HOOKS.
+bool call_graph_attach(call_graph *g, Machine *machine);
+void call_graph_detach(call_graph *g);
+
+// Adds the paths of `from` to `g`.
+void call_graph_add(call_graph *g, const call_graph *from);
+
+// Sets the inclusive cycles of every node.
+void call_graph_totals(call_graph *g);
+
+// Writes the paths with most inclusive cycles, after call_graph_totals.
+void call_graph_report(const call_graph *g, const symbol_table *symbols, FILE *file, int lines);
+
+// Writes one line per path with its exclusive cycles, "root;caller;callee
+// CYCLES", the folded stack format that flame graph tools read.
+bool call_graph_write_folded(const call_graph *g, const symbol_table *symbols, const char *path);
+
+#endif  // CALLGRAPH_H
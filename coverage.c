@@ -0,0 +1,135 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coverage.h"
+
+#ifdef CPU_Z80_WITH_COVERAGE
+
+#define MAX_LINE_LEN 1024
+#define MAP_LINE_LEN 64
+
+static bool bit(const uint8_t *map, int address) {
+	return map[address >> 3] & (1 << (address & 7));
+}
+
+void coverage_add(Z80Coverage *c, const Z80Coverage *from) {
+	for (int i = 0; i < 8192; i++) {
+		c->executed[i] |= from->executed[i];
+		c->data[i] |= from->data[i];
+	}
+}
+
+bool coverage_load(Z80Coverage *c, const char *path) {
+	char magic[8];
+	Z80Coverage loaded;
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return errno == ENOENT;
+	bool ok = fread(magic, sizeof(magic), 1, file) == 1 && !memcmp(magic, COVERAGE_MAGIC, sizeof(magic))
+		&& fread(&loaded, sizeof(loaded), 1, file) == 1;
+	fclose(file);
+	if (ok) coverage_add(c, &loaded);
+	return ok;
+}
+
+bool coverage_save(const Z80Coverage *c, const char *path) {
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) return false;
+	bool ok = fwrite(COVERAGE_MAGIC, 8, 1, file) == 1 && fwrite(c, sizeof(*c), 1, file) == 1;
+	return fclose(file) == 0 && ok;
+}
+
+void coverage_count(const Z80Coverage *c, uint16_t from, uint16_t to, int *executed, int *data) {
+	*executed = *data = 0;
+	for (int address = from; address <= to; address++) {
+		*executed += bit(c->executed, address);
+		*data += bit(c->data, address);
+	}
+}
+
+static char mark(bool executed, bool data, char neither) {
+	return executed ? (data ? 'B' : 'X') : (data ? 'D' : neither);
+}
+
+bool coverage_write_map(const Z80Coverage *c, const char *path) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) return false;
+	for (int line = 0; line < 65536; line += MAP_LINE_LEN) {
+		char text[MAP_LINE_LEN + 1];
+		bool any = false;
+		for (int i = 0; i < MAP_LINE_LEN; i++) {
+			bool executed = bit(c->executed, line + i), data = bit(c->data, line + i);
+			text[i] = mark(executed, data, '.');
+			any |= executed || data;
+		}
+		text[MAP_LINE_LEN] = 0;
+		if (any) fprintf(file, "%.4X  %s\n", line, text);
+	}
+	return fclose(file) == 0;
+}
+
+// Number of hex digits of a token, or 0 if it has other characters
+static int hex_digits(const char *token, int length) {
+	for (int i = 0; i < length; i++) {
+		if (!isxdigit((unsigned char)token[i])) return 0;
+	}
+	return length;
+}
+
+// Finds the address of a listing line, in one of its first two words, and
+// the number of bytes of code or data that follow it
+static bool parse_line(const char *line, uint16_t *address, int *size) {
+	const char *p = line;
+	bool found = false;
+	*size = 0;
+	for (int word = 0; *p; word++) {
+		while (isspace((unsigned char)*p)) p++;
+		int length = strcspn(p, " \t\r\n");
+		if (length == 0) break;
+		if (!found) {
+			int digits = hex_digits(p, length > 0 && p[length - 1] == ':' ? length - 1 : length);
+			if (digits == 4) {
+				*address = strtol(p, NULL, 16);
+				found = true;
+			} else if (word == 1) {
+				return false;
+			}
+		} else if (length % 2 == 0 && length <= 8 && hex_digits(p, length)) {
+			*size += length / 2;
+		} else {
+			break;
+		}
+		p += length;
+	}
+	if (found && *size == 0) *size = 1;
+	return found;
+}
+
+bool coverage_annotate(const Z80Coverage *c, const char *listing, const char *path) {
+	char line[MAX_LINE_LEN];
+	FILE *in = fopen(listing, "r");
+	if (in == NULL) return false;
+	FILE *out = fopen(path, "w");
+	if (out == NULL) {
+		fclose(in);
+		return false;
+	}
+	while (fgets(line, sizeof(line), in)) {
+		uint16_t address;
+		int size;
+		char column = ' ';
+		if (parse_line(line, &address, &size)) {
+			bool data = false;
+			for (int i = 0; i < size; i++) {
+				data |= bit(c->data, (uint16_t)(address + i));
+			}
+			column = mark(bit(c->executed, address), data, '-');
+		}
+		fprintf(out, "%c %s", column, line);
+	}
+	fclose(in);
+	return fclose(out) == 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+// Code coverage of a ROM: the bitmaps that Z80.c fills when built with
+// CPU_Z80_WITH_COVERAGE, merged across jobs and runs and written next to
+// the assembler listing of the ROM.
+
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Z80.h"
+
+#define COVERAGE_MAGIC "Z80COVER"
+
+#ifdef CPU_Z80_WITH_COVERAGE
+
+// Adds the addresses of `from` to `c`.
+void coverage_add(Z80Coverage *c, const Z80Coverage *from);
+
+// Adds the addresses of a file saved by coverage_save to `c`. A file that does
+// not exist adds nothing.
+bool coverage_load(Z80Coverage *c, const char *path);
+bool coverage_save(const Z80Coverage *c, const char *path);
+
+// Counts the addresses from `from` to `to` with any bit set.
+void coverage_count(const Z80Coverage *c, uint16_t from, uint16_t to, int *executed, int *data);
+
+// Writes one line per 64 addresses that have any bit set: the first address
+// and one character per address, X for executed, D for read as data, B for
+// both and . for neither.
+bool coverage_write_map(const Z80Coverage *c, const char *path);
+
+// Copies an assembler listing with a column in front of each line that
+// starts with an address: X if an instruction there was executed, D if any
+// of its bytes was read as data, B for both and - for neither.
+bool coverage_annotate(const Z80Coverage *c, const char *listing, const char *path);
+
+#endif
+
+#endif  // COVERAGE_H
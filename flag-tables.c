@@ -0,0 +1,58 @@
+// Writes Z80-flag-tables.h, the flags of the 8-bit arithmetic and logical
+// instructions for every operand, for builds of Z80.c with
+// CPU_Z80_WITH_FLAG_TABLES. Z80.c is included without that option, so the
+// tables are filled by the same code that they replace.
+//
+//   flag-tables > Z80-flag-tables.h
+
+#include <stdio.h>
+#include "Z80.c"
+
+static void write_values(const char *name, const char *size, zuint8 (*flags)(int index), int count) {
+	printf("static zuint8 const %s%s = {", name, size);
+	for (int index = 0; index < count; index++) {
+		printf("%s%u,", index % 32 ? "" : "\n", flags(index));
+	}
+	printf("\n};\n\n");
+}
+
+// index: carry << 16 | a << 8 | value
+static zuint8 add_flags(int index) {
+	return uuu_flags(index >> 16, index >> 8 & 255, index & 255, index >> 16);
+}
+
+static zuint8 sub_flags(int index) {
+	return uuu_flags(2 + (index >> 16), index >> 8 & 255, index & 255, index >> 16);
+}
+
+// index: result
+static zuint8 logic_flags(int index) {
+	return uuu_flags(6, index, 0, 0);
+}
+
+// index: value before; CF is left to the instruction
+static zuint8 inc_dec_flags(int index, zuint8 opcode) {
+	Z80 cpu = {0};
+	Z80 *object = &cpu;
+	BYTE0 = opcode;
+	_____vvv(object, 0, index);
+	return F;
+}
+
+static zuint8 inc_flags(int index) {
+	return inc_dec_flags(index, 0x3C);
+}
+
+static zuint8 dec_flags(int index) {
+	return inc_dec_flags(index, 0x3D);
+}
+
+int main(void) {
+	printf("/* Generated by flag-tables.c, do not edit. */\n\n");
+	write_values("add_flags_table", "[131072]", add_flags, 2 * 256 * 256);
+	write_values("sub_flags_table", "[131072]", sub_flags, 2 * 256 * 256);
+	write_values("logic_flags_table", "[256]", logic_flags, 256);
+	write_values("inc_flags_table", "[256]", inc_flags, 256);
+	write_values("dec_flags_table", "[256]", dec_flags, 256);
+	return 0;
+}
@@ -0,0 +1,93 @@
+// Runs ADD, ADC, SUB, SBC, AND, XOR, OR, CP, INC and DEC for every A,
+// operand and carry, and prints a hash of the results and flags, which
+// make check compares between builds with and without
+// CPU_Z80_WITH_FLAG_TABLES. The speed goes to stderr.
+//
+//   make check [Z80_OPTIONS=...]
+
+#include <stdio.h>
+#include <time.h>
+#include "Z80.h"
+
+static zuint8 memory[65536];
+static unsigned long long hash = 1469598103934665603ULL;
+static zboolean halted;
+
+// For each operand in B and each A, pushes AF after the operation.
+static const zuint8 program[] = {
+	0x31, 0x00, 0x00,  // 0000 ld sp,0
+	0x01, 0x00, 0x00,  // 0003 ld bc,0
+	0x79,              // 0006 ld a,c
+	0x37,              // 0007 scf, or or a for no carry
+	0x80,              // 0008 the operation
+	0xF5,              // 0009 push af
+	0x33,              // 000A inc sp
+	0x33,              // 000B inc sp
+	0x0C,              // 000C inc c
+	0x20, 0xF7,        // 000D jr nz,0006h
+	0x10, 0xF5,        // 000F djnz 0006h
+	0x76,              // 0011 halt
+};
+
+// add, adc, sub, sbc, and, xor, or and cp a,b; inc a and dec a
+static const zuint8 operations[] = {0x80, 0x88, 0x90, 0x98, 0xA0, 0xA8, 0xB0, 0xB8, 0x3C, 0x3D};
+
+static zuint8 cpu_read(void *context, zuint16 address) {
+	(void)context;
+	return memory[address];
+}
+
+static void cpu_write(void *context, zuint16 address, zuint8 value) {
+	(void)context;
+	hash = (hash ^ (address << 8 | value)) * 1099511628211ULL;
+	memory[address] = value;
+}
+
+static zuint8 cpu_in(void *context, zuint16 port) {
+	(void)context; (void)port;
+	return 0xFF;
+}
+
+static void cpu_out(void *context, zuint16 port, zuint8 value) {
+	(void)context; (void)port; (void)value;
+}
+
+static void cpu_halt(void *context, zboolean state) {
+	(void)context;
+	halted = state;
+}
+
+int main(void) {
+	Z80 cpu = {0};
+	zuint64 cycles = 0;
+	clock_t start = clock();
+
+	cpu.context = &cpu;
+	cpu.read = cpu_read;
+	cpu.write = cpu_write;
+	cpu.in = cpu_in;
+	cpu.out = cpu_out;
+	cpu.halt = cpu_halt;
+
+	for (unsigned i = 0; i < sizeof operations; i++) {
+		for (int carry = 0; carry < 2; carry++) {
+			for (unsigned k = 0; k < sizeof program; k++) memory[k] = program[k];
+			memory[0x07] = carry ? 0x37 : 0xB7;
+			memory[0x08] = operations[i];
+			z80_power(&cpu, TRUE);
+			z80_reset(&cpu);
+			halted = FALSE;
+			// small slices, so that few halted cycles are counted
+			while (!halted) cycles += z80_run(&cpu, 1000);
+		}
+	}
+
+	double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+#ifdef CPU_Z80_WITH_FLAG_TABLES
+	fprintf(stderr, "flag tables: %.1f emulated MHz\n", cycles / seconds / 1e6);
+#else
+	fprintf(stderr, "flag arithmetic: %.1f emulated MHz\n", cycles / seconds / 1e6);
+#endif
+	printf("%016llx\n", hash);
+	return 0;
+}
@@ -0,0 +1,554 @@
+// GDB remote serial protocol server: runs one machine and lets gdb, or any
+// debugger that speaks the protocol, control it over a local socket.
+//
+//   gdb-server [-p PORT | -u PATH] [-c CHECKPOINTS] [-l LATENCY] ROM
+//
+// It listens on 127.0.0.1:PORT (1234 by default) or on the Unix socket PATH,
+// serves one connection and exits. In gdb:
+//
+//   set architecture z80
+//   target remote localhost:1234
+//
+// The registers are those of the gdb z80 target, 16 bits each: AF BC DE HL
+// SP PC IX IY AF' BC' DE' HL' IR. Memory is read and written without the side
+// effects of CPU accesses, a whole 64 KiB per packet if the debugger wants.
+// Breakpoints of both kinds and watchpoints are the machine's, so they cost
+// nothing until hit; watchpoints on overlapping ranges share their bits.
+//
+// The machine runs in real time while continuing, and the connection is only
+// polled for an interrupt between frames. reverse-stepi and reverse-continue
+// go back through CHECKPOINTS checkpoints (256 by default), each about
+// LATENCY seconds (0.02 by default) of replay apart, see history.h.
+// "monitor key 1C F0 1C" sends a PS/2 code to the keyboard. The serial output
+// goes to stdout.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "history.h"
+
+#define MAX_PACKET_LEN (2 * 65536 + 64)  // a whole memory dump in hex
+#define RECEIVE_BUFFER_LEN 4096
+#define REGISTERS 13
+
+static const char target_xml[] =
+	"<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target><architecture>z80</architecture></target>";
+
+typedef struct {
+	int fd;
+	bool ack;  // until the debugger asks for no acknowledgements
+	Machine *machine;
+	history history;
+
+	char input[RECEIVE_BUFFER_LEN];
+	int input_pos;
+	int input_len;
+	char packet[MAX_PACKET_LEN + 1];  // the last received, 0-terminated
+	int packet_len;
+	char output[MAX_PACKET_LEN + 4];  // the last sent, kept to send it again
+	int output_len;
+	uint8_t access_watched[8192];  // addresses under a Z4 watchpoint, one bit each
+} server;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(int c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static char *put_hex(char *p, const uint8_t *data, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		*p++ = hex_digits[data[i] >> 4];
+		*p++ = hex_digits[data[i] & 15];
+	}
+	return p;
+}
+
+// Reads exactly `length` bytes in hex
+static bool get_hex(const char *text, uint8_t *data, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		int high = hex_value(text[2 * i]), low = high < 0 ? -1 : hex_value(text[2 * i + 1]);
+		if (low < 0) return false;
+		data[i] = high << 4 | low;
+	}
+	return text[2 * length] == 0;
+}
+
+static void send_serial(Machine *machine, uint8_t value) {
+	(void)machine;
+	putchar(value);
+	fflush(stdout);
+}
+
+static bool send_all(server *s, const char *data, int length) {
+	while (length > 0) {
+		ssize_t sent = send(s->fd, data, length, 0);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent <= 0) return false;
+		data += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+// The next byte received, or -1 once the connection is closed
+static int next_byte(server *s) {
+	if (s->input_pos == s->input_len) {
+		ssize_t received;
+		do {
+			received = recv(s->fd, s->input, sizeof(s->input), 0);
+		} while (received < 0 && errno == EINTR);
+		if (received <= 0) return -1;
+		s->input_pos = 0;
+		s->input_len = received;
+	}
+	return (uint8_t)s->input[s->input_pos++];
+}
+
+// Reads the next packet, acknowledging it, or an interrupt, which is returned
+// as the packet "\3". Returns false once the connection is closed.
+static bool receive(server *s) {
+	for (;;) {
+		int c;
+		while ((c = next_byte(s)) != '$') {
+			if (c < 0) return false;
+			if (c == 3) {
+				strcpy(s->packet, "\3");
+				s->packet_len = 1;
+				return true;
+			}
+			if (c == '-' && !send_all(s, s->output, s->output_len)) return false;
+		}
+		uint8_t sum = 0;
+		s->packet_len = 0;
+		while ((c = next_byte(s)) != '#') {
+			if (c < 0) return false;
+			if (s->packet_len < MAX_PACKET_LEN) s->packet[s->packet_len++] = c;
+			sum += c;
+		}
+		int high = next_byte(s), low = next_byte(s);
+		if (high < 0 || low < 0) return false;
+		bool ok = (hex_value(high) << 4 | hex_value(low)) == sum;
+		if (s->ack && !send_all(s, ok ? "+" : "-", 1)) return false;
+		if (ok) {
+			s->packet[s->packet_len] = 0;
+			return true;
+		}
+	}
+}
+
+// Sends the reply of `length` bytes written after the '$' of the output
+static bool send_reply(server *s, int length) {
+	uint8_t sum = 0;
+	for (int i = 1; i <= length; i++) sum += s->output[i];
+	s->output[0] = '$';
+	s->output_len = length + 1 + sprintf(s->output + length + 1, "#%c%c", hex_digits[sum >> 4], hex_digits[sum & 15]);
+	return send_all(s, s->output, s->output_len);
+}
+
+static bool reply(server *s, const char *format, ...) {
+	va_list arguments;
+	va_start(arguments, format);
+	int length = vsnprintf(s->output + 1, MAX_PACKET_LEN, format, arguments);
+	va_end(arguments);
+	return send_reply(s, length);
+}
+
+static uint16_t get_register(const ZZ80State *state, int n) {
+	switch (n) {
+	case 0: return state->Z_Z80_STATE_MEMBER_AF;
+	case 1: return state->Z_Z80_STATE_MEMBER_BC;
+	case 2: return state->Z_Z80_STATE_MEMBER_DE;
+	case 3: return state->Z_Z80_STATE_MEMBER_HL;
+	case 4: return state->Z_Z80_STATE_MEMBER_SP;
+	case 5: return state->Z_Z80_STATE_MEMBER_PC;
+	case 6: return state->Z_Z80_STATE_MEMBER_IX;
+	case 7: return state->Z_Z80_STATE_MEMBER_IY;
+	case 8: return state->Z_Z80_STATE_MEMBER_AF_;
+	case 9: return state->Z_Z80_STATE_MEMBER_BC_;
+	case 10: return state->Z_Z80_STATE_MEMBER_DE_;
+	case 11: return state->Z_Z80_STATE_MEMBER_HL_;
+	default: return state->Z_Z80_STATE_MEMBER_I << 8 | state->Z_Z80_STATE_MEMBER_R;
+	}
+}
+
+static void set_register(ZZ80State *state, int n, uint16_t value) {
+	switch (n) {
+	case 0: state->Z_Z80_STATE_MEMBER_AF = value; break;
+	case 1: state->Z_Z80_STATE_MEMBER_BC = value; break;
+	case 2: state->Z_Z80_STATE_MEMBER_DE = value; break;
+	case 3: state->Z_Z80_STATE_MEMBER_HL = value; break;
+	case 4: state->Z_Z80_STATE_MEMBER_SP = value; break;
+	case 5: state->Z_Z80_STATE_MEMBER_PC = value; break;
+	case 6: state->Z_Z80_STATE_MEMBER_IX = value; break;
+	case 7: state->Z_Z80_STATE_MEMBER_IY = value; break;
+	case 8: state->Z_Z80_STATE_MEMBER_AF_ = value; break;
+	case 9: state->Z_Z80_STATE_MEMBER_BC_ = value; break;
+	case 10: state->Z_Z80_STATE_MEMBER_DE_ = value; break;
+	case 11: state->Z_Z80_STATE_MEMBER_HL_ = value; break;
+	default:
+		state->Z_Z80_STATE_MEMBER_I = value >> 8;
+		state->Z_Z80_STATE_MEMBER_R = value;
+	}
+}
+
+// The stop reply for the reason of the last stop, or `signal` if none
+static bool reply_stop(server *s, int signal) {
+	const machine_stop *stop = &s->machine->stop;
+	if (stop->reason == STOP_BREAKPOINT) return reply(s, "T05hwbreak:;");
+	if (stop->reason == STOP_WATCHPOINT && (stop->access & (WATCH_READ | WATCH_WRITE))) {
+		const char *kind = stop->access == WATCH_WRITE ? "watch" : "rwatch";
+		if (s->access_watched[stop->address >> 3] & (1 << (stop->address & 7))) kind = "awatch";
+		return reply(s, "T05%s:%04x;", kind, stop->address);
+	}
+	return reply(s, "S%02x", signal);
+}
+
+static double now_seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Runs in real time until a point is hit or the debugger interrupts
+static bool run(server *s) {
+	Machine *m = s->machine;
+	double start = now_seconds();
+	uint64_t cycles = 0;
+	struct pollfd poll_fd = {s->fd, POLLIN, 0};
+
+	for (;;) {
+		cycles += history_step(&s->history, CYCLES_PER_FRAME);
+		if (m->stop.reason != STOP_NONE) return reply_stop(s, 5);
+
+		// wait for the next frame, or for an interrupt
+		double wait = start + (double)cycles / CYCLES_PER_SECOND - now_seconds();
+		int ready = s->input_pos < s->input_len ? 1 : poll(&poll_fd, 1, wait > 0 ? wait * 1000 : 0);
+		if (ready > 0) {
+			int c = next_byte(s);
+			if (c < 0) return false;
+			if (c == 3) return reply(s, "S02");
+		}
+	}
+}
+
+// c and s packets may give the address to resume at
+static bool resume_at(server *s) {
+	if (s->packet[1] == 0) return true;
+	char *end;
+	unsigned long address = strtoul(s->packet + 1, &end, 16);
+	if (*end || address > 0xFFFF) return false;
+	set_register(&s->machine->cpu.state, 5, address);
+	history_truncate(&s->history);
+	return true;
+}
+
+static bool step(server *s) {
+	Machine *m = s->machine;
+	m->step_end = m->events.cycles;
+	history_step(&s->history, 1);
+	return reply_stop(s, 5);
+}
+
+// Z and z packets: TYPE,ADDRESS,LENGTH
+static bool set_point(server *s, bool set) {
+	unsigned type, address, length;
+	if (sscanf(s->packet + 1, "%x,%x,%x", &type, &address, &length) != 3 || address > 0xFFFF) return reply(s, "E01");
+	uint16_t to = length > 1 ? address + length - 1 : address;
+	if (to < address) to = 0xFFFF;
+	bool ok;
+	switch (type) {
+	case 0:
+	case 1: ok = machine_break(s->machine, address, set); break;
+	case 2: ok = machine_watch(s->machine, WATCH_WRITE, address, to, set); break;
+	case 3: ok = machine_watch(s->machine, WATCH_READ, address, to, set); break;
+	case 4: ok = machine_watch(s->machine, WATCH_READ | WATCH_WRITE, address, to, set); break;
+	default: return reply(s, "");
+	}
+	if (ok && type == 4) {
+		for (unsigned i = address; i <= to; i++) {
+			if (set) s->access_watched[i >> 3] |= 1 << (i & 7);
+			else s->access_watched[i >> 3] &= ~(1 << (i & 7));
+		}
+	}
+	return ok ? reply(s, "OK") : reply(s, "");
+}
+
+static bool read_memory(server *s) {
+	unsigned address, length;
+	uint8_t data[65536];
+	if (sscanf(s->packet + 1, "%x,%x", &address, &length) != 2 || address > 0xFFFF) return reply(s, "E01");
+	if (length > sizeof(data)) length = sizeof(data);
+	machine_peek(s->machine, address, data, length);
+	return send_reply(s, put_hex(s->output + 1, data, length) - (s->output + 1));
+}
+
+// M packets in hex and X packets in binary: ADDRESS,LENGTH:DATA
+static bool write_memory(server *s) {
+	unsigned address, length;
+	uint8_t data[65536];
+	char *colon = memchr(s->packet, ':', s->packet_len);
+	if (colon == NULL || sscanf(s->packet + 1, "%x,%x", &address, &length) != 2 || address > 0xFFFF
+		|| length > sizeof(data)) return reply(s, "E01");
+	if (s->packet[0] == 'M') {
+		if (!get_hex(colon + 1, data, length)) return reply(s, "E01");
+	} else {
+		const char *p = colon + 1, *end = s->packet + s->packet_len;
+		for (unsigned i = 0; i < length; i++) {
+			bool escaped = p < end && *p == '}';
+			p += escaped;
+			if (p >= end) return reply(s, "E01");
+			data[i] = *p++ ^ (escaped ? 0x20 : 0);
+		}
+	}
+	machine_poke(s->machine, address, data, length);
+	history_truncate(&s->history);
+	return reply(s, "OK");
+}
+
+static bool read_registers(server *s) {
+	char *p = s->output + 1;
+	for (int n = 0; n < REGISTERS; n++) {
+		uint16_t value = get_register(&s->machine->cpu.state, n);
+		uint8_t bytes[2] = {value, value >> 8};
+		p = put_hex(p, bytes, 2);
+	}
+	return send_reply(s, p - (s->output + 1));
+}
+
+static bool write_registers(server *s) {
+	uint8_t bytes[REGISTERS * 2];
+	if (!get_hex(s->packet + 1, bytes, sizeof(bytes))) return reply(s, "E01");
+	for (int n = 0; n < REGISTERS; n++) {
+		set_register(&s->machine->cpu.state, n, bytes[2 * n] | bytes[2 * n + 1] << 8);
+	}
+	history_truncate(&s->history);
+	return reply(s, "OK");
+}
+
+// p and P packets: N[=VALUE]
+static bool access_register(server *s) {
+	unsigned n;
+	char *end;
+	uint8_t bytes[2];
+	n = strtoul(s->packet + 1, &end, 16);
+	if (n >= REGISTERS) return reply(s, "E01");
+	if (s->packet[0] == 'p') {
+		uint16_t value = get_register(&s->machine->cpu.state, n);
+		return reply(s, "%02x%02x", value & 0xFF, value >> 8);
+	}
+	if (*end != '=' || !get_hex(end + 1, bytes, 2)) return reply(s, "E01");
+	set_register(&s->machine->cpu.state, n, bytes[0] | bytes[1] << 8);
+	history_truncate(&s->history);
+	return reply(s, "OK");
+}
+
+// qXfer:features:read:target.xml:OFFSET,LENGTH
+static bool read_features(server *s) {
+	unsigned offset, length;
+	const char *annex = s->packet + strlen("qXfer:features:read:");
+	if (strncmp(annex, "target.xml:", 11) || sscanf(annex + 11, "%x,%x", &offset, &length) != 2) return reply(s, "E00");
+	size_t size = sizeof(target_xml) - 1;
+	if (offset >= size) return reply(s, "l");
+	if (length > size - offset) length = size - offset;
+	return reply(s, "%c%.*s", offset + length < size ? 'm' : 'l', (int)length, target_xml + offset);
+}
+
+// qRcmd,COMMAND in hex: only "key BYTE...", whose answer is sent as output
+static bool monitor(server *s) {
+	char command[256];
+	uint8_t code[MAX_KEY_CODE_LEN];
+	int length = 0, used;
+	size_t size = strlen(s->packet + 6) / 2;
+	unsigned byte;
+	if (size >= sizeof(command) || !get_hex(s->packet + 6, (uint8_t *)command, size)) return reply(s, "E01");
+	command[size] = 0;
+
+	const char *message = "usage: monitor key BYTE...\n";
+	if (!strncmp(command, "key ", 4)) {
+		const char *p = command + 4;
+		while (length < MAX_KEY_CODE_LEN && sscanf(p, "%x%n", &byte, &used) == 1 && byte <= 0xFF) {
+			code[length++] = byte;
+			p += used;
+		}
+		if (length > 0) {
+			message = history_key(&s->history, code, length) ? "sent\n" : "the keyboard is busy\n";
+		}
+	}
+	char *p = s->output + 1;
+	*p++ = 'O';
+	p = put_hex(p, (const uint8_t *)message, strlen(message));
+	if (!send_reply(s, p - (s->output + 1))) return false;
+	return reply(s, "OK");
+}
+
+// Handles one packet; returns false to end the session
+static bool handle(server *s) {
+	char *p = s->packet;
+	switch (p[0]) {
+	case 3:
+		return reply(s, "S02");
+	case '?':
+		return reply_stop(s, 5);
+	case 'g':
+		return read_registers(s);
+	case 'G':
+		return write_registers(s);
+	case 'p':
+	case 'P':
+		return access_register(s);
+	case 'm':
+		return read_memory(s);
+	case 'M':
+	case 'X':
+		return write_memory(s);
+	case 'c':
+		if (!resume_at(s)) return reply(s, "E01");
+		return run(s);
+	case 's':
+		if (!resume_at(s)) return reply(s, "E01");
+		return step(s);
+	case 'b':
+		if (p[1] == 's') {
+			if (!history_reverse_step(&s->history)) return reply(s, "T05replaylog:begin;");
+			return reply(s, "S05");
+		}
+		if (p[1] == 'c') {
+			if (history_reverse_continue(&s->history) == STOP_NONE) return reply(s, "T05replaylog:begin;");
+			return reply_stop(s, 5);
+		}
+		return reply(s, "");
+	case 'Z':
+	case 'z':
+		return set_point(s, p[0] == 'Z');
+	case 'H':
+		return reply(s, "OK");
+	case 'k':
+		return false;
+	case 'D':
+		reply(s, "OK");
+		return false;
+	case 'q':
+		if (!strncmp(p, "qSupported", 10)) {
+			return reply(s, "PacketSize=%x;QStartNoAckMode+;qXfer:features:read+;hwbreak+;ReverseStep+;ReverseContinue+",
+				MAX_PACKET_LEN);
+		}
+		if (!strcmp(p, "qAttached")) return reply(s, "1");
+		if (!strcmp(p, "qC")) return reply(s, "QC1");
+		if (!strcmp(p, "qfThreadInfo")) return reply(s, "m1");
+		if (!strcmp(p, "qsThreadInfo")) return reply(s, "l");
+		if (!strncmp(p, "qXfer:features:read:", 20)) return read_features(s);
+		if (!strncmp(p, "qRcmd,", 6)) return monitor(s);
+		return reply(s, "");
+	case 'Q':
+		if (!strcmp(p, "QStartNoAckMode")) {
+			bool ok = reply(s, "OK");
+			s->ack = false;
+			return ok;
+		}
+		return reply(s, "");
+	case 'v':
+		if (!strcmp(p, "vCont?")) return reply(s, "vCont;c;s");
+		if (!strncmp(p, "vCont;c", 7)) return run(s);
+		if (!strncmp(p, "vCont;s", 7)) return step(s);
+		return reply(s, "");
+	default:
+		return reply(s, "");
+	}
+}
+
+// Listens on a TCP port of the loopback interface or on a Unix socket, and
+// returns the first connection
+static int accept_connection(int port, const char *path) {
+	int listener, fd;
+	if (path) {
+		struct sockaddr_un address = {.sun_family = AF_UNIX};
+		if (strlen(path) >= sizeof(address.sun_path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		strcpy(address.sun_path, path);
+		unlink(path);
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0) return -1;
+		fprintf(stderr, "listening on %s\n", path);
+	} else {
+		struct sockaddr_in address = {
+			.sin_family = AF_INET,
+			.sin_port = htons(port),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+		};
+		int yes = 1;
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		if (listener < 0) return -1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+		if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0) return -1;
+		fprintf(stderr, "listening on 127.0.0.1:%d\n", port);
+	}
+	if (listen(listener, 1) < 0) return -1;
+	fd = accept(listener, NULL, NULL);
+	close(listener);
+	if (path) unlink(path);
+	return fd;
+}
+
+int main(int argc, char *argv[]) {
+	static server s;
+	static uint8_t rom[32 * 1024];
+	const char *path = NULL, *program = argv[0];
+	int port = 1234, checkpoints = 256, option;
+	double latency = 0.02;
+
+	while ((option = getopt(argc, argv, "p:u:c:l:")) != -1) {
+		switch (option) {
+		case 'p': port = atoi(optarg); break;
+		case 'u': path = optarg; break;
+		case 'c': checkpoints = atoi(optarg); break;
+		case 'l': latency = atof(optarg); break;
+		default: return 2;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-p PORT | -u PATH] [-c CHECKPOINTS] [-l LATENCY] ROM\n", program);
+		return 2;
+	}
+
+	FILE *file = fopen(argv[optind], "rb");
+	if (file == NULL) {
+		fprintf(stderr, "can not read %s: %s\n", argv[optind], strerror(errno));
+		return 2;
+	}
+	size_t rom_size = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+	s.machine = machine_create(rom, rom_size);
+	if (s.machine == NULL || !history_init(&s.history, s.machine, checkpoints, latency)) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	s.machine->serial_out = send_serial;
+
+	s.fd = accept_connection(port, path);
+	if (s.fd < 0) {
+		fprintf(stderr, "can not listen: %s\n", strerror(errno));
+		return 1;
+	}
+	s.ack = true;
+	while (receive(&s) && handle(&s)) {
+	}
+	close(s.fd);
+	history_free(&s.history);
+	machine_destroy(s.machine);
+	return 0;
+}
@@ -0,0 +1,96 @@
+// Checks that the opcode histogram of Z80.c accounts for every cycle run,
+// through block repeat instructions, HALT and an idle loop, which z80_run
+// otherwise shortcuts. Exits with 1 if not.
+//
+//   make check [Z80_OPTIONS=...]
+
+#include <stdio.h>
+#include "Z80.h"
+
+static zuint8 memory[65536];
+
+static const zuint8 program[] = {
+	0x31, 0x00, 0x00,  // 0000 ld sp,0
+	0xED, 0x56,        // 0003 im 1
+	0xFB,              // 0005 ei
+	0x21, 0x00, 0x10,  // 0006 ld hl,1000h
+	0x11, 0x00, 0x20,  // 0009 ld de,2000h
+	0x01, 0x00, 0x04,  // 000C ld bc,400h
+	0xED, 0xB0,        // 000F ldir
+	0xAF,              // 0011 xor a
+	0x76,              // 0012 halt
+	0xFE, 0x02,        // 0013 cp 2
+	0x38, 0xFC,        // 0015 jr c,0013h
+	0x18, 0xED,        // 0017 jr 0006h
+};
+
+static const zuint8 handler[] = {
+	0x3C,  // 0038 inc a
+	0xFB,  // 0039 ei
+	0xC9,  // 003A ret
+};
+
+static zuint8 cpu_read(void *context, zuint16 address) {
+	(void)context;
+	return memory[address];
+}
+
+static void cpu_write(void *context, zuint16 address, zuint8 value) {
+	(void)context;
+	memory[address] = value;
+}
+
+static zuint8 cpu_in(void *context, zuint16 port) {
+	(void)context; (void)port;
+	return 0xFF;
+}
+
+static void cpu_out(void *context, zuint16 port, zuint8 value) {
+	(void)context; (void)port; (void)value;
+}
+
+static zuint32 cpu_int_data(void *context) {
+	(void)context;
+	return 0;
+}
+
+int main(void) {
+	static Z80Histogram histogram;
+	Z80 cpu = {0};
+	zuint64 cycles = 0, counted = 0;
+
+	for (unsigned i = 0; i < sizeof program; i++) memory[i] = program[i];
+	for (unsigned i = 0; i < sizeof handler; i++) memory[0x38 + i] = handler[i];
+
+	cpu.context = &cpu;
+	cpu.read = cpu_read;
+	cpu.write = cpu_write;
+	cpu.in = cpu_in;
+	cpu.out = cpu_out;
+	cpu.int_data = cpu_int_data;
+	z80_power(&cpu, TRUE);
+	z80_reset(&cpu);
+	cpu.histogram = &histogram;
+
+	// An interrupt every 30000 cycles, held for about one instruction.
+	for (int i = 0; i < 1000; i++) {
+		z80_int(&cpu, TRUE);
+		cycles += z80_run(&cpu, 1);
+		z80_int(&cpu, FALSE);
+		cycles += z80_run(&cpu, 30000);
+	}
+
+	for (int t = 0; t < 5; t++) {
+		for (int k = 0; k < 256; k++) {
+			counted += histogram.cycles[t][k];
+		}
+	}
+	counted += histogram.interrupt_cycles;
+
+	printf("%llu cycles run, %llu counted, %llu ldir, %llu halt, %llu interrupts\n",
+		(unsigned long long)cycles, (unsigned long long)counted,
+		(unsigned long long)histogram.count[Z80_HISTOGRAM_TABLE_ED][0xB0],
+		(unsigned long long)histogram.count[Z80_HISTOGRAM_TABLE][0x76],
+		(unsigned long long)histogram.int_count[1]);
+	return counted == cycles && histogram.int_count[1] ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "history.h"
+
+// longer than any instruction, interrupt acceptance or repeat iteration
+#define MAX_STEP_CYCLES 64
+#define MIN_SPACING 100000
+
+static double now_seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint64_t now(const history *h) {
+	return h->machine->events.cycles;
+}
+
+static checkpoint *newest(const history *h) {
+	return h->checkpoints[h->count - 1];
+}
+
+// The newest checkpoint at or before `cycle`, or -1
+static int find(const history *h, uint64_t cycle) {
+	int i = h->count - 1;
+	while (i >= 0 && h->checkpoints[i]->cycle > cycle) i--;
+	return i;
+}
+
+// The keys sent before the oldest checkpoint are not needed any more
+static void drop_inputs(history *h, int count) {
+	memmove(h->inputs, h->inputs + count, (h->input_count - count) * sizeof(input));
+	h->input_count -= count;
+	h->replayed -= count;
+	for (int i = 0; i < h->count; i++) {
+		h->checkpoints[i]->inputs -= count;
+	}
+}
+
+// Checkpoints the current cycle, reusing the oldest checkpoint if all are used
+static void add_checkpoint(history *h) {
+	if (h->count == h->capacity) {
+		checkpoint *oldest = h->checkpoints[0];
+		memmove(h->checkpoints, h->checkpoints + 1, (h->count - 1) * sizeof(checkpoint *));
+		h->checkpoints[--h->count] = oldest;
+		drop_inputs(h, h->checkpoints[0]->inputs);
+	}
+	checkpoint *c = h->checkpoints[h->count++];
+	c->cycle = now(h);
+	c->inputs = h->replayed;
+	machine_save(h->machine, c->state);
+
+	// from the speed since the last one, the next one is `latency` away
+	if (h->seconds > 0 && h->cycles > 0) {
+		uint64_t spacing = h->cycles / h->seconds * h->latency;
+		h->spacing = spacing < MIN_SPACING ? MIN_SPACING : spacing;
+	}
+	h->seconds = 0;
+	h->cycles = 0;
+}
+
+static void load(history *h, int index) {
+	machine_load(h->machine, h->checkpoints[index]->state);
+	h->replayed = h->checkpoints[index]->inputs;
+}
+
+// Sends the recorded keys due at the current cycle
+static void send_inputs(history *h) {
+	while (h->replayed < h->input_count && h->inputs[h->replayed].cycle <= now(h)) {
+		input *i = &h->inputs[h->replayed++];
+		machine_key(h->machine, i->code, i->length);
+	}
+}
+
+// The cycle of the next recorded key, or `cycle` if it is earlier
+static uint64_t next_input(const history *h, uint64_t cycle) {
+	if (h->replayed < h->input_count && h->inputs[h->replayed].cycle < cycle) return h->inputs[h->replayed].cycle;
+	return cycle;
+}
+
+// Runs the machine to the first instruction boundary at or after `cycle`,
+// from a cycle before it, with the overshoot correction of machine_step
+static void run_until(Machine *m, uint64_t cycle) {
+	machine_step(m, cycle - m->step_end);
+}
+
+// Runs again to the first instruction boundary at or after `cycle`, sending
+// the recorded keys. The points are off unless `last` is given; then the last
+// hit before cycle `before` is copied to it, and its cycle to `last_cycle`.
+static void replay(history *h, uint64_t cycle, machine_stop *last, uint64_t *last_cycle, uint64_t before) {
+	Machine *m = h->machine;
+	void (*serial_out)(Machine *, uint8_t) = m->serial_out;
+	void *debug = m->debug;
+
+	m->serial_out = NULL;
+	if (last == NULL) m->debug = NULL;
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	// only the points are looked for, the other conditions wait for the present
+	zuint8 stops = m->cpu.stops;
+	m->cpu.stops = last == NULL ? 0 : stops & Z80_STOP_BREAKPOINTS;
+#endif
+	while (now(h) < cycle) {
+		send_inputs(h);
+		run_until(m, next_input(h, cycle));
+		if (m->stop.reason != STOP_NONE && now(h) < before) {
+			*last = m->stop;
+			*last_cycle = now(h);
+		}
+	}
+	m->serial_out = serial_out;
+	m->debug = debug;
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	m->cpu.stops = stops;
+#endif
+	m->stop = (machine_stop){STOP_NONE};
+}
+
+bool history_init(history *h, Machine *m, int capacity, double latency) {
+	memset(h, 0, sizeof(*h));
+	h->machine = m;
+	h->latency = latency;
+	h->capacity = capacity < 2 ? 2 : capacity;
+	h->spacing = MIN_SPACING * 10;
+	h->checkpoints = calloc(h->capacity, sizeof(checkpoint *));
+	h->scratch = malloc(machine_state_size());
+	bool ok = h->checkpoints && h->scratch;
+	for (int i = 0; ok && i < h->capacity; i++) {
+		ok = (h->checkpoints[i] = malloc(sizeof(checkpoint) + machine_state_size())) != NULL;
+	}
+	if (!ok) {
+		history_free(h);
+		return false;
+	}
+	add_checkpoint(h);
+	return true;
+}
+
+void history_free(history *h) {
+	for (int i = 0; h->checkpoints && i < h->capacity; i++) {
+		free(h->checkpoints[i]);
+	}
+	free(h->checkpoints);
+	free(h->scratch);
+	free(h->inputs);
+	memset(h, 0, sizeof(*h));
+}
+
+uint64_t history_step(history *h, uint64_t cycles) {
+	Machine *m = h->machine;
+	uint64_t start = now(h), end = m->step_end + cycles;
+	double begin = now_seconds();
+
+	m->stop = (machine_stop){STOP_NONE};
+	for (;;) {
+		if (now(h) >= newest(h)->cycle + h->spacing) add_checkpoint(h);
+		send_inputs(h);
+		if (now(h) >= end) break;
+
+		uint64_t until = next_input(h, end);
+		if (until > newest(h)->cycle + h->spacing) until = newest(h)->cycle + h->spacing;
+		run_until(m, until);
+		if (m->stop.reason != STOP_NONE) break;
+	}
+	h->seconds += now_seconds() - begin;
+	h->cycles += now(h) - start;
+	return now(h) - start;
+}
+
+bool history_key(history *h, const uint8_t *code, int length) {
+	history_truncate(h);
+	if (!machine_key(h->machine, code, length)) return false;
+	if (h->input_count == h->input_capacity) {
+		h->input_capacity = h->input_capacity ? h->input_capacity * 2 : 64;
+		h->inputs = realloc(h->inputs, h->input_capacity * sizeof(input));
+	}
+	input *i = &h->inputs[h->input_count++];
+	i->cycle = now(h);
+	memcpy(i->code, code, length);
+	i->length = length;
+	h->replayed = h->input_count;
+	return true;
+}
+
+void history_truncate(history *h) {
+	uint64_t cycle = now(h);
+	if (h->replayed == h->input_count && newest(h)->cycle < cycle) return;
+
+	// the new future starts from the state as it is now
+	h->input_count = h->replayed;
+	while (h->count && newest(h)->cycle >= cycle) h->count--;
+	add_checkpoint(h);
+}
+
+bool history_seek(history *h, uint64_t cycle) {
+	int index = find(h, cycle);
+	if (index < 0) return false;
+	// going forward, from the current cycle if no checkpoint is nearer
+	if (cycle < now(h) || h->checkpoints[index]->cycle > now(h)) load(h, index);
+	replay(h, cycle, NULL, NULL, 0);
+	return true;
+}
+
+bool history_reverse_step(history *h) {
+	Machine *m = h->machine;
+	uint64_t cycle = now(h);
+	int index = cycle ? find(h, cycle - 1) : -1;
+	if (index < 0) return false;
+
+	// run close to it, then one step at a time from a copy of the state to
+	// find the last instruction boundary before it, and run there again
+	load(h, index);
+	if (cycle - now(h) > MAX_STEP_CYCLES) replay(h, cycle - MAX_STEP_CYCLES, NULL, NULL, 0);
+	uint64_t previous = now(h);
+	int replayed = h->replayed;
+	machine_save(m, h->scratch);
+	while (now(h) < cycle) {
+		previous = now(h);
+		replay(h, now(h) + 1, NULL, NULL, 0);
+	}
+	machine_load(m, h->scratch);
+	h->replayed = replayed;
+	replay(h, previous, NULL, NULL, 0);
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	m->cpu.breakpoint_hit = TRUE;
+#endif
+	return true;
+}
+
+int history_reverse_continue(history *h) {
+	Machine *m = h->machine;
+	uint64_t cycle = now(h);
+	int index = cycle ? find(h, cycle - 1) : -1;
+
+	// from the newest checkpoint back, the first one followed by a hit
+	for (; m->debug && index >= 0; index--) {
+		uint64_t end = index + 1 < h->count && h->checkpoints[index + 1]->cycle < cycle
+			? h->checkpoints[index + 1]->cycle : cycle;
+		machine_stop hit = {STOP_NONE};
+		uint64_t hit_cycle = 0;
+
+		// a watchpoint hit at `end` is after an instruction of this interval
+		load(h, index);
+		replay(h, end, &hit, &hit_cycle, end < cycle ? end + 1 : cycle);
+		if (hit.reason == STOP_NONE) continue;
+
+		load(h, index);
+		replay(h, hit_cycle, NULL, NULL, 0);
+		m->stop = hit;
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+		m->cpu.breakpoint_hit = hit.reason == STOP_BREAKPOINT;
+#endif
+		return hit.reason;
+	}
+	load(h, 0);
+	return STOP_NONE;
+}
@@ -0,0 +1,83 @@
+// Reverse execution: a machine run through history_step is checkpointed
+// every few million cycles, and any earlier instruction is reached again by
+// loading the nearest checkpoint before it and running forward from there.
+// The spacing of the checkpoints follows the speed of the emulation, so that
+// running forward from one takes about `latency` seconds, and only the last
+// `capacity` are kept, so memory is bounded and so is how far back it goes.
+//
+// Keys must be sent through history_key, so that they are sent again at the
+// same cycles. The serial output is not repeated while going back, but any
+// profiler, call graph, trace or coverage attached sees the instructions run
+// again.
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "machine.h"
+
+typedef struct {
+	uint64_t cycle;
+	int inputs;  // keys sent before it, counted from the first one kept
+	uint8_t state[];  // see machine_save
+} checkpoint;
+
+typedef struct {
+	uint64_t cycle;
+	uint8_t code[MAX_KEY_CODE_LEN];
+	int length;
+} input;
+
+typedef struct {
+	Machine *machine;
+	double latency;
+
+	checkpoint **checkpoints;  // all allocated up front, the first `count` used, oldest first
+	int count;
+	int capacity;
+	uint64_t spacing;  // cycles from the newest checkpoint to the next one
+	void *scratch;  // a state saved while going back one instruction
+
+	input *inputs;  // since the oldest checkpoint
+	int input_count;
+	int input_capacity;
+	int replayed;  // inputs sent in the current run; the rest are replayed
+
+	// time spent stepping since the last checkpoint, for the spacing
+	double seconds;
+	uint64_t cycles;
+} history;
+
+// Starts recording with a first checkpoint at the current cycle. Returns
+// false if out of memory.
+bool history_init(history *h, Machine *machine, int capacity, double latency);
+void history_free(history *h);
+
+// Same as machine_step, taking checkpoints when due and sending again the
+// keys recorded after the current cycle, if it went back.
+uint64_t history_step(history *h, uint64_t cycles);
+
+// Same as machine_key. If the machine went back, it starts a new future: the
+// keys and checkpoints recorded after the current cycle are forgotten.
+bool history_key(history *h, const uint8_t *code, int length);
+
+// Forgets the future after the current cycle, for example after changing
+// registers or memory.
+void history_truncate(history *h);
+
+// Goes to the first instruction boundary at or after `cycle`, sending the
+// keys recorded on the way but taking no checkpoints. Returns false if it is
+// before the oldest checkpoint.
+bool history_seek(history *h, uint64_t cycle);
+
+// Goes back one instruction, or one accepted interrupt. Returns false at the
+// oldest checkpoint.
+bool history_reverse_step(history *h);
+
+// Goes back to the last breakpoint or watchpoint hit before the current cycle
+// and returns the reason, also in machine->stop, like machine_step. Goes to
+// the oldest checkpoint and returns STOP_NONE if there is none.
+int history_reverse_continue(history *h);
+
+#endif  // HISTORY_H
@@ -1104,8 +1104,6 @@ Released under the terms of the GNU Lesser General Public License v3. */
 
 #endif
 
-#endif /* _Z_inspection_modules_compiler_Clang_H_ */
-
 
 
 
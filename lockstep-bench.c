@@ -0,0 +1,151 @@
+// Compares lockstep_run with independent z80_run calls on a group of CPUs
+// that run the same program on different data, checks that both end in the
+// same state and prints the emulated instructions per second of each.
+//
+//   lockstep-bench [CPUS [CYCLES]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lockstep.h"
+
+// A register-heavy loop with data-dependent branches and one store
+static const uint8_t program[] = {
+	0x31, 0x00, 0xFF,  //       ld sp,$FF00
+	0x21, 0x00, 0x80,  //       ld hl,$8000
+	0x78,              // loop: ld a,b
+	0x07,              //       rlca
+	0xA8,              //       xor b
+	0x47,              //       ld b,a
+	0x0F,              //       rrca
+	0xA9,              //       xor c
+	0x4F,              //       ld c,a
+	0x81,              //       add a,c
+	0x8A,              //       adc a,d
+	0x57,              //       ld d,a
+	0xE6, 0x07,        //       and 7
+	0x20, 0x04,        //       jr nz,skip
+	0x7A,              //       ld a,d
+	0x2F,              //       cpl
+	0x5F,              //       ld e,a
+	0x1C,              //       inc e
+	0x7B,              // skip: ld a,e
+	0x92,              //       sub d
+	0xDE, 0x11,        //       sbc a,$11
+	0x5F,              //       ld e,a
+	0xFE, 0x80,        //       cp $80
+	0x38, 0x01,        //       jr c,low
+	0x1D,              //       dec e
+	0x73,              // low:  ld (hl),e
+	0x2C,              //       inc l
+	0xC3, 0x06, 0x00,  //       jp loop
+};
+
+typedef struct {
+	Z80 cpu;
+	uint8_t memory[65536];
+} computer;
+
+static zuint8 read(void *context, zuint16 address) {
+	return ((computer *)context)->memory[address];
+}
+
+static void write(void *context, zuint16 address, zuint8 value) {
+	((computer *)context)->memory[address] = value;
+}
+
+static zuint8 in(void *context, zuint16 port) {
+	(void)context; (void)port;
+	return 0xFF;
+}
+
+static void out(void *context, zuint16 port, zuint8 value) {
+	(void)context; (void)port; (void)value;
+}
+
+static zuint32 int_data(void *context) {
+	(void)context;
+	return 0;
+}
+
+static double now_seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void init(computer *c, int index) {
+	uint32_t seed = index * 2654435761u + 1;
+	memset(c, 0, sizeof(*c));
+	memcpy(c->memory, program, sizeof(program));
+	c->cpu.context = c;
+	c->cpu.read = read;
+	c->cpu.write = write;
+	c->cpu.in = in;
+	c->cpu.out = out;
+	c->cpu.int_data = int_data;
+	c->cpu.halt = NULL;
+#ifdef CPU_Z80_WITH_MEMORY_MAP
+	for (int page = 0; page < 256; page++) {
+		c->cpu.read_map[page] = c->memory + page * 256;
+		c->cpu.write_map[page] = c->memory + page * 256;
+	}
+#endif
+	z80_power(&c->cpu, 1);
+	z80_reset(&c->cpu);
+	c->cpu.state.Z_Z80_STATE_MEMBER_BC = seed >> 16;
+	c->cpu.state.Z_Z80_STATE_MEMBER_DE = seed;
+}
+
+static bool same(const computer *a, const computer *b) {
+	return !memcmp(&a->cpu.state, &b->cpu.state, sizeof(a->cpu.state))
+		&& !memcmp(a->memory, b->memory, sizeof(a->memory));
+}
+
+int main(int argc, char *argv[]) {
+	int count = argc > 1 ? atoi(argv[1]) : LOCKSTEP_LANES;
+	uint32_t cycles = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000000;
+	if (count < 1 || count > LOCKSTEP_LANES) {
+		fprintf(stderr, "CPUS must be 1 to %d\n", LOCKSTEP_LANES);
+		return 2;
+	}
+
+	computer *group = malloc(count * sizeof(computer));
+	computer *alone = malloc(count * sizeof(computer));
+	Z80 *cpus[LOCKSTEP_LANES];
+	for (int i = 0; i < count; i++) {
+		init(&group[i], i);
+		init(&alone[i], i);
+		cpus[i] = &group[i].cpu;
+	}
+
+	double start = now_seconds();
+	for (int i = 0; i < count; i++) {
+		z80_run(&alone[i].cpu, cycles);
+	}
+	double alone_seconds = now_seconds() - start;
+
+	lockstep l;
+	lockstep_init(&l, cpus, count, program, sizeof(program));
+	start = now_seconds();
+	lockstep_run(&l, cycles);
+	double group_seconds = now_seconds() - start;
+
+	int failed = 0;
+	for (int i = 0; i < count; i++) {
+		failed += !same(&group[i], &alone[i]);
+	}
+
+	// both runs execute the same instructions
+	double instructions = l.vector_instructions + l.scalar_instructions;
+	printf("%d CPUs, %u cycles each, %d differ\n", count, cycles, failed);
+	printf("z80_run:  %.2f s, %.1f M instructions/s\n", alone_seconds, instructions / alone_seconds / 1e6);
+	printf("lockstep: %.2f s, %.1f M instructions/s, %.1f%% on vectors, %.1f CPUs per vector step\n",
+		group_seconds, instructions / group_seconds / 1e6,
+		100 * l.vector_instructions / instructions,
+		l.vector_steps ? (double)l.vector_instructions / l.vector_steps : 0);
+	free(group);
+	free(alone);
+	return failed != 0;
+}
@@ -0,0 +1,430 @@
+#include <string.h>
+#include "lockstep.h"
+
+#define SF 0x80
+#define ZF 0x40
+#define YF 0x20
+#define HF 0x10
+#define XF 0x08
+#define PF 0x04
+#define NF 0x02
+#define CF 0x01
+#define SYXF (SF | YF | XF)
+#define YXF (YF | XF)
+
+#define A 7
+
+typedef int8_t mask8 __attribute__((vector_size(LOCKSTEP_LANES)));
+typedef int16_t mask16 __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+
+// Masks are 0xFF in the selected lanes and 0 in the others
+#define SELECT(mask, a, b) (((a) & (mask)) | ((b) & ~(mask)))
+#define MASK16(mask) ((lockstep_u16)__builtin_convertvector((mask8)(mask), mask16))
+
+// Slowest instruction with a vector implementation
+#define MAX_STEP_CYCLES 13
+
+static bool any(lockstep_u8 mask) {
+	uint64_t words[LOCKSTEP_LANES / 8];
+	uint64_t any = 0;
+	memcpy(words, &mask, sizeof(words));
+	for (int i = 0; i < LOCKSTEP_LANES / 8; i++) {
+		any |= words[i];
+	}
+	return any != 0;
+}
+
+static lockstep_u8 zero(lockstep_u8 value) {
+	return (lockstep_u8)(value == 0) & ZF;
+}
+
+static lockstep_u8 parity(lockstep_u8 value) {
+	value ^= value >> 4;
+	value ^= value >> 2;
+	value ^= value >> 1;
+	return (~value & 1) << 2;
+}
+
+// Moves the registers of one CPU between the lanes and its Z80 struct
+static void gather(lockstep *l, int lane) {
+	Z80 *cpu = l->cpus[lane];
+#ifdef CPU_Z80_WITH_LAZY_FLAGS
+	z80_update_flags(cpu);
+#endif
+	l->reg[0][lane] = cpu->state.Z_Z80_STATE_MEMBER_B;
+	l->reg[1][lane] = cpu->state.Z_Z80_STATE_MEMBER_C;
+	l->reg[2][lane] = cpu->state.Z_Z80_STATE_MEMBER_D;
+	l->reg[3][lane] = cpu->state.Z_Z80_STATE_MEMBER_E;
+	l->reg[4][lane] = cpu->state.Z_Z80_STATE_MEMBER_H;
+	l->reg[5][lane] = cpu->state.Z_Z80_STATE_MEMBER_L;
+	l->reg[A][lane] = cpu->state.Z_Z80_STATE_MEMBER_A;
+	l->f[lane] = cpu->state.Z_Z80_STATE_MEMBER_F;
+	l->r[lane] = cpu->state.Z_Z80_STATE_MEMBER_R;
+	l->pc_low[lane] = cpu->state.Z_Z80_STATE_MEMBER_PC;
+	l->pc_high[lane] = cpu->state.Z_Z80_STATE_MEMBER_PC >> 8;
+}
+
+static void scatter(lockstep *l, int lane) {
+	Z80 *cpu = l->cpus[lane];
+	cpu->state.Z_Z80_STATE_MEMBER_B = l->reg[0][lane];
+	cpu->state.Z_Z80_STATE_MEMBER_C = l->reg[1][lane];
+	cpu->state.Z_Z80_STATE_MEMBER_D = l->reg[2][lane];
+	cpu->state.Z_Z80_STATE_MEMBER_E = l->reg[3][lane];
+	cpu->state.Z_Z80_STATE_MEMBER_H = l->reg[4][lane];
+	cpu->state.Z_Z80_STATE_MEMBER_L = l->reg[5][lane];
+	cpu->state.Z_Z80_STATE_MEMBER_A = l->reg[A][lane];
+	cpu->state.Z_Z80_STATE_MEMBER_F = l->f[lane];
+	cpu->state.Z_Z80_STATE_MEMBER_R = l->r[lane];
+	cpu->state.Z_Z80_STATE_MEMBER_PC = l->pc_low[lane] | (l->pc_high[lane] << 8);
+}
+
+static uint32_t lane_cycles(const lockstep *l, int lane) {
+	return l->base[lane] + l->cycles[lane];
+}
+
+// A CPU can take part in a vector step unless it has used up its cycles or
+// z80_run has something else to do first: an interrupt or the halt state.
+// Right after ei, interrupts are not accepted until the next instruction.
+static bool ready(const lockstep *l, int lane, uint32_t cycles) {
+	const Z80 *cpu = l->cpus[lane];
+	return lane_cycles(l, lane) < cycles
+		&& !cpu->state.Z_Z80_STATE_MEMBER_HALT
+		&& !cpu->state.Z_Z80_STATE_MEMBER_EI
+		&& !cpu->state.Z_Z80_STATE_MEMBER_NMI
+		&& !(cpu->state.Z_Z80_STATE_MEMBER_IRQ && cpu->state.Z_Z80_STATE_MEMBER_IFF1);
+}
+
+// Vector steps that a ready CPU can take part in before it could reach the
+// end of the run
+static uint32_t safe_steps(const lockstep *l, int lane, uint32_t cycles) {
+	return (cycles - lane_cycles(l, lane) - 1) / MAX_STEP_CYCLES + 1;
+}
+
+static void scalar_step(lockstep *l, int lane, uint32_t cycles) {
+	Z80 *cpu = l->cpus[lane];
+	bool wake = cpu->state.Z_Z80_STATE_MEMBER_NMI
+		|| (cpu->state.Z_Z80_STATE_MEMBER_IRQ && cpu->state.Z_Z80_STATE_MEMBER_IFF1);
+	l->base[lane] += l->cycles[lane];
+	l->cycles[lane] = 0;
+	scatter(l, lane);
+	// nothing in the group can end a halt, so a halted CPU runs to the end
+	if (cpu->state.Z_Z80_STATE_MEMBER_HALT && !wake) {
+		l->base[lane] += z80_run(cpu, cycles - l->base[lane]);
+	} else {
+		l->base[lane] += z80_run(cpu, 1);
+	}
+	gather(l, lane);
+	l->ready[lane] = 0;
+	if (ready(l, lane, cycles)) {
+		uint32_t steps = safe_steps(l, lane, cycles);
+		l->ready[lane] = 0xFF;
+		if (steps < l->steps_left) l->steps_left = steps;
+	}
+	l->scalar_instructions++;
+}
+
+// Moves the narrow cycle counters to base and finds how many vector steps can
+// run before doing it again
+static void flush(lockstep *l, uint32_t cycles) {
+	l->steps_left = 0xFFFF / MAX_STEP_CYCLES;
+	for (int i = 0; i < l->count; i++) {
+		l->base[i] += l->cycles[i];
+		l->cycles[i] = 0;
+		if (l->ready[i]) {
+			if (l->base[i] >= cycles) {
+				l->ready[i] = 0;
+			} else {
+				uint32_t steps = safe_steps(l, i, cycles);
+				if (steps < l->steps_left) l->steps_left = steps;
+			}
+		}
+	}
+}
+
+static void alu(lockstep *l, lockstep_u8 m, int operation, lockstep_u8 v) {
+	lockstep_u8 a = l->reg[A], f = l->f, t, flags;
+	lockstep_u8 carry = operation == 1 || operation == 3 ? f & CF : (lockstep_u8){0};
+
+	switch (operation) {
+	case 0:  // add
+	case 1:  // adc
+		t = a + v + carry;
+		flags = (((a & v) | ((a | v) & ~t)) >> 7)
+			| (((~(a ^ v) & (a ^ t)) >> 5) & PF)
+			| ((a ^ v ^ t) & HF)
+			| (t & SYXF) | zero(t);
+		break;
+	case 2:  // sub
+	case 3:  // sbc
+	case 7:  // cp
+		t = a - v - carry;
+		flags = (((~a & v) | (~(a ^ v) & t)) >> 7)
+			| NF
+			| ((((a ^ v) & (a ^ t)) >> 5) & PF)
+			| ((a ^ v ^ t) & HF)
+			| zero(t);
+		if (operation == 7) {
+			flags |= (t & SF) | (v & YXF);
+			t = a;
+		} else {
+			flags |= t & SYXF;
+		}
+		break;
+	case 4:  // and
+		t = a & v;
+		flags = HF | parity(t) | (t & SYXF) | zero(t);
+		break;
+	case 5:  // xor
+		t = a ^ v;
+		flags = parity(t) | (t & SYXF) | zero(t);
+		break;
+	default:  // or
+		t = a | v;
+		flags = parity(t) | (t & SYXF) | zero(t);
+		break;
+	}
+	l->reg[A] = SELECT(m, t, a);
+	l->f = SELECT(m, flags, f);
+}
+
+static lockstep_u8 inc_dec(lockstep *l, lockstep_u8 m, bool dec, lockstep_u8 v) {
+	lockstep_u8 t, pn;
+	if (dec) {
+		t = v - 1;
+		pn = ((lockstep_u8)(v == 128) & PF) | NF;
+	} else {
+		t = v + 1;
+		pn = (lockstep_u8)(v == 127) & PF;
+	}
+	l->f = SELECT(m, (l->f & CF) | pn | (t & SYXF) | ((v ^ 1 ^ t) & HF) | zero(t), l->f);
+	return SELECT(m, t, v);
+}
+
+// Condition of jp cc and jr cc, as a mask
+static lockstep_u8 condition(const lockstep *l, int cc) {
+	static const uint8_t flag[4] = {ZF, CF, PF, SF};
+	lockstep_u8 set = (lockstep_u8)((l->f & flag[cc >> 1]) != 0);
+	return cc & 1 ? set : ~set;
+}
+
+// Executes the instruction at `*pc` in the lanes of mask `m`, if it has a
+// vector implementation, and sets `*pc` to the next one. Returns false if it
+// does not. Sets `*diverged` if the lanes took different branches, and so
+// have no common PC.
+static bool vector_step(lockstep *l, lockstep_u8 m, uint16_t *pc, bool *diverged) {
+	const uint8_t *code = l->code + *pc;
+	uint8_t opcode = code[0];
+	int y = (opcode >> 3) & 7, z = opcode & 7;
+	uint16_t next = *pc + 1;
+	uint16_t cost = 4;
+	lockstep_u8 taken = {0};  // lanes that jump to `target`
+	uint16_t target = 0;
+	uint16_t cost_taken = 0;
+
+	// every instruction below has at most 3 bytes
+	if ((uint32_t)*pc + 3 > l->code_size) return false;
+
+	switch (opcode) {
+	case 0x00:  // nop
+		break;
+
+	case 0x03: case 0x13: case 0x23:  // inc rr
+	case 0x0B: case 0x1B: case 0x2B: {  // dec rr
+		lockstep_u8 *high = &l->reg[y & 6], *low = &l->reg[(y & 6) + 1];
+		lockstep_u8 limit = opcode & 8 ? (lockstep_u8){0} : (lockstep_u8){0} - 1;
+		lockstep_u8 carry = (lockstep_u8)(*low == limit) & m;
+		lockstep_u8 step = opcode & 8 ? (lockstep_u8){0} - 1 : (lockstep_u8){0} + 1;
+		*high += carry & step;
+		*low += m & step;
+		cost = 6;
+		break;
+	}
+
+	case 0x07:  // rlca
+		l->reg[A] = SELECT(m, (l->reg[A] << 1) | (l->reg[A] >> 7), l->reg[A]);
+		l->f = SELECT(m, (l->f & (SF | ZF | PF)) | (l->reg[A] & (YXF | CF)), l->f);
+		break;
+	case 0x0F:  // rrca
+		l->reg[A] = SELECT(m, (l->reg[A] >> 1) | (l->reg[A] << 7), l->reg[A]);
+		l->f = SELECT(m, (l->f & (SF | ZF | PF)) | (l->reg[A] & YXF) | (l->reg[A] >> 7), l->f);
+		break;
+	case 0x17: {  // rla
+		lockstep_u8 c = l->reg[A] >> 7;
+		l->reg[A] = SELECT(m, (l->reg[A] << 1) | (l->f & CF), l->reg[A]);
+		l->f = SELECT(m, (l->f & (SF | ZF | PF)) | (l->reg[A] & YXF) | c, l->f);
+		break;
+	}
+	case 0x1F: {  // rra
+		lockstep_u8 c = l->reg[A] & 1;
+		l->reg[A] = SELECT(m, (l->reg[A] >> 1) | (l->f << 7), l->reg[A]);
+		l->f = SELECT(m, (l->f & (SF | ZF | PF)) | (l->reg[A] & YXF) | c, l->f);
+		break;
+	}
+	case 0x2F:  // cpl
+		l->reg[A] = SELECT(m, ~l->reg[A], l->reg[A]);
+		l->f = SELECT(m, (l->f & (SF | ZF | PF | CF)) | HF | NF | (l->reg[A] & YXF), l->f);
+		break;
+	case 0x37:  // scf
+		l->f = SELECT(m, (l->f & (SF | ZF | PF)) | (l->reg[A] & YXF) | CF, l->f);
+		break;
+	case 0x3F:  // ccf
+		l->f = SELECT(m, (l->f & (SF | ZF | PF)) | (l->reg[A] & YXF) | ((l->f & CF) << 4) | (~l->f & CF), l->f);
+		break;
+
+	case 0x10:  // djnz OFFSET
+		l->reg[0] = SELECT(m, l->reg[0] - 1, l->reg[0]);
+		taken = (lockstep_u8)(l->reg[0] != 0);
+		target = *pc + 2 + (int8_t)code[1];
+		next = *pc + 2;
+		cost = 8;
+		cost_taken = 13;
+		break;
+	case 0x18:  // jr OFFSET
+		next = *pc + 2 + (int8_t)code[1];
+		cost = 12;
+		break;
+	case 0x20: case 0x28: case 0x30: case 0x38:  // jr cc,OFFSET
+		taken = condition(l, y - 4);
+		target = *pc + 2 + (int8_t)code[1];
+		next = *pc + 2;
+		cost = 7;
+		cost_taken = 12;
+		break;
+
+	case 0xC3:  // jp WORD
+		next = code[1] | (code[2] << 8);
+		cost = 10;
+		break;
+	case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+	case 0xE2: case 0xEA: case 0xF2: case 0xFA:  // jp cc,WORD
+		taken = condition(l, y);
+		target = code[1] | (code[2] << 8);
+		next = *pc + 3;
+		cost = cost_taken = 10;
+		break;
+
+	default:
+		if (opcode >= 0x40 && opcode < 0x80) {  // ld r,r'
+			if (y == 6 || z == 6) return false;
+			l->reg[y] = SELECT(m, l->reg[z], l->reg[y]);
+		} else if (opcode >= 0x80 && opcode < 0xC0) {  // alu r
+			if (z == 6) return false;
+			alu(l, m, y, l->reg[z]);
+		} else if ((opcode & 0xC7) == 0xC6) {  // alu BYTE
+			alu(l, m, y, (lockstep_u8){0} + code[1]);
+			next = *pc + 2;
+			cost = 7;
+		} else if ((opcode & 0xC7) == 0x06 && y != 6) {  // ld r,BYTE
+			l->reg[y] = SELECT(m, (lockstep_u8){0} + code[1], l->reg[y]);
+			next = *pc + 2;
+			cost = 7;
+		} else if ((opcode & 0xC6) == 0x04 && y != 6) {  // inc r, dec r
+			l->reg[y] = inc_dec(l, m, z & 1, l->reg[y]);
+		} else {
+			return false;
+		}
+	}
+
+	taken &= m;
+	*diverged = false;
+	if (!any(taken)) {
+		*pc = next;
+	} else if (!any(m & ~taken)) {
+		*pc = target;
+		cost = cost_taken;
+	} else {
+		lockstep_u16 taken16 = MASK16(taken);
+		lockstep_u8 low = SELECT(taken, (lockstep_u8){0} + (uint8_t)target, (lockstep_u8){0} + (uint8_t)next);
+		lockstep_u8 high = SELECT(taken, (lockstep_u8){0} + (uint8_t)(target >> 8), (lockstep_u8){0} + (uint8_t)(next >> 8));
+		l->pc_low = SELECT(m, low, l->pc_low);
+		l->pc_high = SELECT(m, high, l->pc_high);
+		l->cycles += SELECT(taken16, (lockstep_u16){0} + cost_taken, (lockstep_u16){0} + cost) & MASK16(m);
+		*diverged = true;
+	}
+	if (!*diverged) {
+		l->pc_low = SELECT(m, (lockstep_u8){0} + (uint8_t)*pc, l->pc_low);
+		l->pc_high = SELECT(m, (lockstep_u8){0} + (uint8_t)(*pc >> 8), l->pc_high);
+		l->cycles += MASK16(m) & cost;
+	}
+	l->r = SELECT(m, (l->r & 0x80) | ((l->r + 1) & 0x7F), l->r);
+	l->vector_steps++;
+	return true;
+}
+
+void lockstep_init(lockstep *l, Z80 **cpus, int count, const uint8_t *code, uint32_t code_size) {
+	memset(l, 0, sizeof(*l));
+	l->count = count < LOCKSTEP_LANES ? count : LOCKSTEP_LANES;
+	memcpy(l->cpus, cpus, l->count * sizeof(Z80 *));
+	l->code = code;
+	l->code_size = code_size;
+}
+
+void lockstep_run(lockstep *l, uint32_t cycles) {
+	lockstep_u8 m = {0};
+	uint16_t pc = 0;
+	int count = 0;
+	bool converged = false;
+
+	l->cycles = (lockstep_u16){0};
+	for (int i = 0; i < l->count; i++) {
+		l->base[i] = 0;
+		gather(l, i);
+		l->ready[i] = ready(l, i, cycles) ? 0xFF : 0;
+	}
+	l->steps_left = 0;
+
+	for (;;) {
+		if (l->steps_left == 0) {
+			flush(l, cycles);
+			converged = false;
+		}
+
+		// While all the ready CPUs are at the same PC, the group stays the
+		// same. Otherwise, first the CPUs that have something else to do run
+		// on their own, then the group is made of the CPUs at the lowest PC,
+		// so that CPUs behind catch up with the ones ahead and the group joins
+		// again after a branch.
+		if (!converged) {
+			uint32_t lowest = UINT32_MAX;
+			bool busy = false;
+			for (int i = 0; i < l->count; i++) {
+				if (l->ready[i]) {
+					uint32_t address = l->pc_low[i] | (l->pc_high[i] << 8);
+					if (address < lowest) lowest = address;
+				} else if (lane_cycles(l, i) < cycles) {
+					scalar_step(l, i, cycles);
+					busy = true;
+				}
+			}
+			if (lowest == UINT32_MAX) {
+				if (busy) continue;
+				break;
+			}
+			pc = lowest;
+			m = l->ready
+				& (lockstep_u8)(l->pc_low == (uint8_t)pc)
+				& (lockstep_u8)(l->pc_high == (uint8_t)(pc >> 8));
+			converged = !any(l->ready & ~m);
+			count = 0;
+			for (int i = 0; i < l->count; i++) {
+				count += m[i] & 1;
+			}
+		}
+
+		bool diverged;
+		if (vector_step(l, m, &pc, &diverged)) {
+			l->vector_instructions += count;
+			l->steps_left--;
+			if (diverged) converged = false;
+		} else {
+			for (int i = 0; i < l->count; i++) {
+				if (m[i]) scalar_step(l, i, cycles);
+			}
+			converged = false;
+		}
+	}
+
+	for (int i = 0; i < l->count; i++) {
+		scatter(l, i);
+	}
+}
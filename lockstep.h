@@ -0,0 +1,62 @@
+// Runs a group of Z80s that execute the same code in lockstep: while several
+// CPUs are at the same PC, the instruction is executed for all of them at once
+// on vector registers holding one CPU per lane. CPUs whose PC differs, and
+// instructions that access memory or I/O, fall back to z80_run for one
+// instruction. Experimental, for batch throughput on native builds.
+
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Z80.h"
+
+#if !defined(__GNUC__)
+#	error "lockstep.c uses the GCC vector extensions"
+#endif
+
+// One AVX2 register of 8-bit lanes
+#define LOCKSTEP_LANES 32
+
+typedef uint8_t lockstep_u8 __attribute__((vector_size(LOCKSTEP_LANES)));
+typedef uint16_t lockstep_u16 __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+
+typedef struct {
+	int count;
+	Z80 *cpus[LOCKSTEP_LANES];
+
+	// Code that is the same for all the CPUs, at address 0; only instructions
+	// fetched from here are executed in lockstep.
+	const uint8_t *code;
+	uint32_t code_size;
+
+	// statistics, accumulated over all lockstep_run calls
+	uint64_t vector_steps;         // instructions executed on vectors
+	uint64_t vector_instructions;  // the same, once per CPU
+	uint64_t scalar_instructions;  // z80_run calls
+
+	// While running, the registers that vector instructions use are kept here,
+	// one CPU per lane, instead of in the Z80 structs.
+	lockstep_u8 reg[8];  // b, c, d, e, h, l, unused, a: the r field order
+	lockstep_u8 f;
+	lockstep_u8 r;
+	lockstep_u8 pc_low;
+	lockstep_u8 pc_high;
+	lockstep_u8 ready;  // 0xFF for the CPUs that can run the next step on vectors
+
+	// Cycles run by each CPU in this lockstep_run are base + cycles. Vector
+	// steps only add to the narrow counters, which are moved to base when
+	// `steps_left` runs out, before any of the CPUs could use up its cycles.
+	uint32_t base[LOCKSTEP_LANES];
+	lockstep_u16 cycles;
+	uint32_t steps_left;
+} lockstep;
+
+// The CPUs must have been powered on. At most LOCKSTEP_LANES CPUs.
+void lockstep_init(lockstep *l, Z80 **cpus, int count, const uint8_t *code, uint32_t code_size);
+
+// Runs every CPU for at least `cycles` cycles, as z80_run would. The
+// callbacks of a CPU must not change the state of the other CPUs.
+void lockstep_run(lockstep *l, uint32_t cycles);
+
+#endif  // LOCKSTEP_H
@@ -0,0 +1,551 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine.h"
+
+// a PS/2 byte is 11 bits at about 12.5 kHz
+#define CYCLES_PER_PS2_BYTE (CYCLES_PER_SECOND/12500*11)
+
+// accesses that go through the callbacks are added to the CPU trace, if any
+#ifdef CPU_Z80_WITH_TRACE
+#define TRACE(m, type, address, value) z80_trace(&(m)->cpu, type, address, value)
+#else
+#define TRACE(m, type, address, value)
+#endif
+
+// and the data reads to its coverage, if any; the test of the fetches is
+// inlined because most reads are fetches
+#ifdef CPU_Z80_WITH_COVERAGE
+#define COVER_READ(m, address) \
+	if ((m)->cpu.coverage && !(m)->cpu.fetching) z80_cover_read(&(m)->cpu, address)
+#else
+#define COVER_READ(m, address)
+#endif
+
+// breakpoints and watchpoints, one bit per address or port low byte
+typedef struct {
+	uint8_t execute[8192];
+	uint8_t read[8192];
+	uint8_t write[8192];
+	uint8_t in[32];
+	uint8_t out[32];
+	int count;  // bits set in all the maps
+	int reads, writes;  // bits set in the read and write maps
+} debug_points;
+
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+static bool is_point(const uint8_t *map, int index) {
+	return map[index >> 3] & (1 << (index & 7));
+}
+
+// the first watched access of the instruction is reported, and the machine
+// stops after it
+static void watch_hit(Machine *m, int access, uint16_t address, uint8_t value) {
+	if (m->stop.reason != STOP_NONE) return;
+	m->stop = (machine_stop){STOP_WATCHPOINT, access, m->cpu.break_pc, address, value};
+	scheduler_stop(&m->events);
+}
+
+#define WATCH(m, map, access, address, value) \
+	if ((m)->debug && is_point(((debug_points *)(m)->debug)->map, address)) watch_hit(m, access, address, value)
+#else
+#define WATCH(m, map, access, address, value)
+#endif
+
+static void set_video_mode(Machine *m, uint8_t value) {
+	uint8_t scrollX_h = (value & 0b00000011);
+	uint8_t zoomX_bit = (value & 0b00000100) >> 2;
+	uint8_t scrollY_h = (value & 0b00110000) >> 4;
+	uint8_t zoomY_bit = (value & 0b01000000) >> 6;
+	uint8_t txt_m_bit = (value & 0b10000000) >> 7;
+
+	m->scrollX = (m->scrollX & 0x0ff) | (scrollX_h << 8);
+	m->scrollY = (m->scrollY & 0x0ff) | (scrollY_h << 8);
+
+	m->zoomX = !!zoomX_bit;
+	m->zoomY = !!zoomY_bit;
+	m->text_mode = !!txt_m_bit;
+
+	m->video_dirty = 1;
+}
+
+static void video_write(Machine *m, uint8_t *table, uint8_t value, bool increment) {
+	table[m->vram_address] = value;
+	if (increment) {
+		m->vram_address = (m->vram_address + 1) & 0x1fff;
+	}
+	m->video_dirty = 1;
+}
+
+static uint8_t mem_read(void *context, uint16_t address) {
+	Machine *m = context;
+	uint8_t value = address & 0x8000 ? m->ram[address & 0x7FFF] : m->rom[address & 0x7FFF];
+	TRACE(m, Z80_TRACE_READ, address, value);
+	COVER_READ(m, address);
+	WATCH(m, read, WATCH_READ, address, value);
+	return value;
+}
+
+static void mem_write(void *context, uint16_t address, uint8_t value) {
+	Machine *m = context;
+	TRACE(m, Z80_TRACE_WRITE, address, value);
+	WATCH(m, write, WATCH_WRITE, address, value);
+	if (address & 0x8000) {
+		m->ram[address & 0x7FFF] = value;
+	} else {
+		// nothing happens
+	}
+};
+
+static uint8_t io_in(void *context, uint16_t port) {
+	Machine *m = context;
+	uint8_t result = 0;
+	switch (port & 0xff) {
+	case 0xB8:
+		result = m->vram_name[m->vram_address];
+		break;
+
+	case 0xB9:
+		result = m->vram_attribute[m->vram_address];
+		break;
+
+	case 0xBA:
+		result = m->vram_pattern[m->vram_address];
+		break;
+
+	case 0xBB:
+		result = m->vram_palette[m->vram_address];
+		break;
+
+	case 0xBC:
+		result = m->vram_name[m->vram_address];
+		m->vram_address = (m->vram_address + 1) & 0x1fff;
+		break;
+
+	case 0xBD:
+		result = m->vram_attribute[m->vram_address];
+		m->vram_address = (m->vram_address + 1) & 0x1fff;
+		break;
+
+	case 0xBE:
+		result = m->vram_pattern[m->vram_address];
+		m->vram_address = (m->vram_address + 1) & 0x1fff;
+		break;
+
+	case 0xBF:
+		result = m->vram_palette[m->vram_address];
+		m->vram_address = (m->vram_address + 1) & 0x1fff;
+		break;
+
+	case 0xC0:
+		if (m->keyboard_buffer_pos < m->keyboard_buffer_len) {
+			result = m->keyboard_buffer[m->keyboard_buffer_pos++];
+		} else {
+			result = 0x00;
+		}
+		break;
+
+	case 0xC1:
+		if (m->keyboard_buffer_pos < m->keyboard_buffer_len) {
+			result = 0x01;
+		} else {
+			result = 0x00;
+		}
+		break;
+
+	case 0xC3:
+		// sender ready and all data sent
+		result = 0b00000101;
+		break;
+	}
+
+	TRACE(m, Z80_TRACE_IN, port, result);
+	WATCH(m, in, WATCH_IN, port & 0xff, result);
+	return result;
+};
+
+static void io_out(void *context, uint16_t port, uint8_t value) {
+	Machine *m = context;
+	TRACE(m, Z80_TRACE_OUT, port, value);
+	WATCH(m, out, WATCH_OUT, port & 0xff, value);
+	switch (port & 0xff) {
+	case 0xB0:
+		m->scrollX = (m->scrollX & 0x300) | value;
+		m->video_dirty = 1;
+		break;
+
+	case 0xB1:
+		m->scrollY = (m->scrollY & 0x300) | value;
+		m->video_dirty = 1;
+		break;
+
+	case 0xB2:
+		set_video_mode(m, value);
+		break;
+
+	case 0xB3:
+		m->vram_address = (m->vram_address & 0x1f00) | value;
+		break;
+
+	case 0xB4:
+		m->vram_address = (m->vram_address & 0x00ff) | ((value & 0x1F) << 8);
+		break;
+
+	case 0xB8:
+		video_write(m, m->vram_name, value, 0);
+		break;
+
+	case 0xB9:
+		video_write(m, m->vram_attribute, value, 0);
+		break;
+
+	case 0xBA:
+		video_write(m, m->vram_pattern, value, 0);
+		break;
+
+	case 0xBB:
+		video_write(m, m->vram_palette, value, 0);
+		break;
+
+	case 0xBC:
+		video_write(m, m->vram_name, value, 1);
+		break;
+
+	case 0xBD:
+		video_write(m, m->vram_attribute, value, 1);
+		break;
+
+	case 0xBE:
+		video_write(m, m->vram_pattern, value, 1);
+		break;
+
+	case 0xBF:
+		video_write(m, m->vram_palette, value, 1);
+		break;
+
+	case 0xC1:
+		switch (m->sio_register_selected_a) {
+		case 0:
+			m->sio_register_selected_a = value & 0x07;
+			break;
+		case 1:
+			if (value & 0b00011000) {
+				m->keyboard_interrupts_enabled = 1;
+			} else {
+				m->keyboard_interrupts_enabled = 0;
+			};
+			if (m->keyboard_interrupts) {
+				m->keyboard_interrupts(m, m->keyboard_interrupts_enabled);
+			}
+			m->sio_register_selected_a = 0;
+			break;
+		default:
+			m->sio_register_selected_a = 0;
+		}
+		break;
+
+	case 0xC2:
+		if (m->serial_out) {
+			m->serial_out(m, value);
+		}
+		break;
+
+	case 0xC3:
+		switch (m->sio_register_selected_b) {
+		case 0:
+			m->sio_register_selected_b = value & 0x07;
+			break;
+		case 2:
+			m->sio_interrupt_vector = value;
+			m->sio_register_selected_b = 0;
+			break;
+		default:
+			m->sio_register_selected_a = 0;
+		}
+		break;
+	}
+};
+
+static uint32_t int_data(void *context) {
+	Machine *m = context;
+	uint8_t result = m->sio_interrupt_vector;
+	z80_int(&m->cpu, 0);
+	//printf("interrupt acknowledge %.2x\n", result);
+	return result << 24;
+
+};
+
+static void halt_changed(void *context, zboolean state) {
+	// nothing happens
+	(void)context;
+	(void)state;
+};
+
+#ifdef CPU_Z80_WITH_IDLE_LOOPS
+static void idle(void *context, uint16_t address, zusize skipped) {
+	Machine *m = context;
+	m->idle_cycles += skipped;
+	m->idle_address = address;
+}
+
+// ports that can be read without side effects
+static const uint8_t idempotent_ports[] = {0xB8, 0xB9, 0xBA, 0xBB, 0xC1, 0xC3};
+#endif
+
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+// several conditions met at once are reported as the first of these
+static void breakpoint(void *context, uint16_t address, zuint8 reasons) {
+	Machine *m = context;
+	int reason = reasons & Z80_STOP_BREAKPOINTS ? STOP_BREAKPOINT
+		: reasons & Z80_STOP_INSTRUCTIONS ? STOP_INSTRUCTIONS : STOP_CONDITION;
+	m->stop = (machine_stop){reason, 0, address, address, 0};
+	scheduler_stop(&m->events);
+}
+
+static zboolean check(void *context, uint16_t address) {
+	Machine *m = context;
+	return m->condition(m, address, m->condition_context);
+}
+#endif
+
+// the whole code is in the buffer once its last byte has been received
+static void keyboard_received(void *context, uint64_t cycle) {
+	Machine *m = context;
+	(void)cycle;
+	memcpy(m->keyboard_buffer, m->keyboard_pending, m->keyboard_pending_len);
+	m->keyboard_buffer_len = m->keyboard_pending_len;
+	m->keyboard_buffer_pos = 0;
+	m->keyboard_pending_len = 0;
+	if (m->keyboard_interrupts_enabled) {
+		z80_int(&m->cpu, 1);
+	}
+}
+
+bool machine_key(Machine *m, const uint8_t *code, int length) {
+	if (m->keyboard_pending_len || length > MAX_KEY_CODE_LEN) return false;
+	memcpy(m->keyboard_pending, code, length);
+	m->keyboard_pending_len = length;
+	return scheduler_add(&m->events, scheduler_now(&m->events) + length * CYCLES_PER_PS2_BYTE, keyboard_received, m);
+}
+
+// Accesses to mapped pages skip mem_read and mem_write, so the pages are
+// unmapped for the accesses that watchpoints, a trace or a coverage must
+// see; breakpoints are checked by the CPU and keep both maps
+static void map_memory(Machine *m) {
+#ifdef CPU_Z80_WITH_MEMORY_MAP
+	const debug_points *d = m->debug;
+	bool read = d == NULL || d->reads == 0;
+	bool write = d == NULL || d->writes == 0;
+#ifdef CPU_Z80_WITH_TRACE
+	read &= m->cpu.trace == NULL;
+	write &= m->cpu.trace == NULL;
+#endif
+#ifdef CPU_Z80_WITH_COVERAGE
+	read &= m->cpu.coverage == NULL;
+#endif
+	if (read == (m->cpu.read_map[0] != NULL) && write == (m->cpu.write_map[128] != NULL)) return;
+	for (int page = 0; page < 128; page++) {
+		m->cpu.read_map[page] = read ? m->rom + page * 256 : NULL;
+		m->cpu.read_map[page + 128] = read ? m->ram + page * 256 : NULL;
+		m->cpu.write_map[page + 128] = write ? m->ram + page * 256 : NULL;
+	}
+#else
+	(void)m;
+#endif
+}
+
+static void init_cpu(Machine *m) {
+	m->cpu.context = m;
+	m->cpu.read = mem_read;
+	m->cpu.write = mem_write;
+	m->cpu.in = io_in;
+	m->cpu.out = io_out;
+	m->cpu.int_data = int_data;
+	m->cpu.halt = halt_changed;
+	map_memory(m);
+#ifdef CPU_Z80_WITH_IDLE_LOOPS
+	m->cpu.idle = idle;
+	for (size_t i = 0; i < sizeof(idempotent_ports); i++) {
+		m->cpu.idempotent_ports[idempotent_ports[i] >> 3] |= 1 << (idempotent_ports[i] & 7);
+	}
+#endif
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	m->cpu.breakpoint = breakpoint;
+	m->cpu.check = check;
+#endif
+	z80_power(&m->cpu, 1);
+	z80_reset(&m->cpu);
+	scheduler_init(&m->events, &m->cpu);
+}
+
+// VRAM powers up with garbage; a private generator keeps machines independent
+static void init_video(Machine *m) {
+	uint32_t seed = 1;
+	for (size_t i = 0; i < 8192; i++) {
+		seed = seed * 1103515245 + 12345;
+		m->vram_name[i] = (seed >> 16) % 255;
+		seed = seed * 1103515245 + 12345;
+		m->vram_attribute[i] = (seed >> 16) % 255;
+		seed = seed * 1103515245 + 12345;
+		m->vram_pattern[i] = (seed >> 16) % 255;
+		seed = seed * 1103515245 + 12345;
+		m->vram_palette[i] = (seed >> 16) % 255;
+	}
+	m->vram_address = 0;
+	m->video_dirty = 1;
+}
+
+Machine *machine_create(const uint8_t *rom, size_t rom_size) {
+	Machine *m = calloc(1, sizeof(Machine));
+	if (m == NULL) return NULL;
+	if (rom_size > sizeof(m->rom)) rom_size = sizeof(m->rom);
+	memcpy(m->rom, rom, rom_size);
+	init_video(m);
+	init_cpu(m);
+	return m;
+}
+
+void machine_destroy(Machine *m) {
+	if (m == NULL) return;
+	free(m->debug);
+	free(m);
+}
+
+uint64_t machine_step(Machine *m, uint64_t cycles) {
+	uint64_t start = m->events.cycles;
+	m->stop = (machine_stop){STOP_NONE};
+	m->step_end += cycles;
+	map_memory(m);
+	scheduler_run(&m->events, m->step_end);
+	// the rest of a stopped step is dropped, not run by the next one
+	if (m->stop.reason != STOP_NONE) m->step_end = m->events.cycles;
+	return m->events.cycles - start;
+}
+
+// Sets or clears the bits `from` to `to` of a map of the points of the
+// machine, which are allocated on the first one and freed with the last one
+static bool set_points(Machine *m, size_t offset, int from, int to, int mask, bool set) {
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	if (m->debug == NULL) {
+		if (!set) return true;
+		if ((m->debug = calloc(1, sizeof(debug_points))) == NULL) return false;
+		m->cpu.breakpoints = ((debug_points *)m->debug)->execute;
+		m->cpu.stops |= Z80_STOP_BREAKPOINTS;
+	}
+	debug_points *d = m->debug;
+	uint8_t *map = (uint8_t *)d + offset;
+	for (int i = from; i <= to; i++) {
+		int index = i & mask;
+		if (is_point(map, index) == set) continue;
+		map[index >> 3] ^= 1 << (index & 7);
+		d->count += set ? 1 : -1;
+		if (map == d->read) d->reads += set ? 1 : -1;
+		if (map == d->write) d->writes += set ? 1 : -1;
+	}
+	if (d->count == 0) machine_clear_points(m);
+	return true;
+#else
+	(void)m; (void)offset; (void)from; (void)to; (void)mask; (void)set;
+	return false;
+#endif
+}
+
+bool machine_break(Machine *m, uint16_t address, bool set) {
+	return set_points(m, offsetof(debug_points, execute), address, address, 0xFFFF, set);
+}
+
+bool machine_watch(Machine *m, int accesses, uint16_t from, uint16_t to, bool set) {
+	bool ok = true;
+	if (accesses & WATCH_READ) ok &= set_points(m, offsetof(debug_points, read), from, to, 0xFFFF, set);
+	if (accesses & WATCH_WRITE) ok &= set_points(m, offsetof(debug_points, write), from, to, 0xFFFF, set);
+	if (accesses & WATCH_IN) ok &= set_points(m, offsetof(debug_points, in), from, to, 0xFF, set);
+	if (accesses & WATCH_OUT) ok &= set_points(m, offsetof(debug_points, out), from, to, 0xFF, set);
+	return ok;
+}
+
+// what machine_save copies; the events are in the same machine
+typedef struct {
+	ZZ80State cpu;
+	scheduler events;
+	uint8_t devices[offsetof(Machine, serial_out) - offsetof(Machine, ram)];
+} machine_state;
+
+size_t machine_state_size(void) {
+	return sizeof(machine_state);
+}
+
+void machine_save(const Machine *m, void *state) {
+	machine_state *saved = state;
+	saved->cpu = m->cpu.state;
+	saved->events = m->events;
+	memcpy(saved->devices, m->ram, sizeof(saved->devices));
+}
+
+void machine_load(Machine *m, const void *state) {
+	const machine_state *saved = state;
+	m->cpu.state = saved->cpu;
+	m->events = saved->events;
+	memcpy(m->ram, saved->devices, sizeof(saved->devices));
+	m->step_end = m->events.cycles;
+	m->stop = (machine_stop){STOP_NONE};
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	m->cpu.breakpoint_hit = FALSE;
+#endif
+}
+
+void machine_peek(const Machine *m, uint16_t address, uint8_t *data, size_t length) {
+	for (size_t i = 0; i < length; i++, address++) {
+		data[i] = address & 0x8000 ? m->ram[address & 0x7FFF] : m->rom[address & 0x7FFF];
+	}
+}
+
+void machine_poke(Machine *m, uint16_t address, const uint8_t *data, size_t length) {
+	for (size_t i = 0; i < length; i++, address++) {
+		if (address & 0x8000) m->ram[address & 0x7FFF] = data[i];
+	}
+}
+
+void machine_clear_points(Machine *m) {
+	free(m->debug);
+	m->debug = NULL;
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	m->cpu.breakpoints = NULL;
+	m->cpu.stops &= ~Z80_STOP_BREAKPOINTS;
+	m->cpu.breakpoint_hit = FALSE;
+#endif
+}
+
+bool machine_stop_after(Machine *m, uint64_t instructions) {
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	m->cpu.instructions_left = instructions;
+	if (instructions) m->cpu.stops |= Z80_STOP_INSTRUCTIONS;
+	else m->cpu.stops &= ~Z80_STOP_INSTRUCTIONS;
+	return true;
+#else
+	(void)m; (void)instructions;
+	return false;
+#endif
+}
+
+bool machine_stop_when(Machine *m, machine_condition condition, void *context) {
+#ifdef CPU_Z80_WITH_BREAKPOINTS
+	m->condition = condition;
+	m->condition_context = context;
+	if (condition) m->cpu.stops |= Z80_STOP_CHECK;
+	else m->cpu.stops &= ~Z80_STOP_CHECK;
+	return true;
+#else
+	(void)m; (void)condition; (void)context;
+	return false;
+#endif
+}
+
+#ifdef EMU21_STATIC_BUS
+// compile the CPU here, at the end so that its macros do not leak into the
+// machine, with the bus functions above inlined into its instructions
+#define CPU_Z80_BUS_READ(context, address) mem_read(context, address)
+#define CPU_Z80_BUS_WRITE(context, address, value) mem_write(context, address, value)
+#define CPU_Z80_BUS_IN(context, port) io_in(context, port)
+#define CPU_Z80_BUS_OUT(context, port, value) io_out(context, port, value)
+#include "Z80.c"
+#endif
@@ -0,0 +1,157 @@
+// The emulated computer: CPU, memory, video, SIO and keyboard. All state is
+// in the Machine struct, so any number of machines can run at the same time,
+// each one on a single thread.
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "scheduler.h"
+#include "Z80.h"
+
+#define CYCLES_PER_SECOND 10000000
+#define CYCLES_PER_FRAME (CYCLES_PER_SECOND/60)
+#define MAX_KEY_CODE_LEN 8
+
+// accesses that a watchpoint can watch
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+#define WATCH_IN 4
+#define WATCH_OUT 8
+
+// why machine_step returned early
+#define STOP_NONE 0
+#define STOP_BREAKPOINT 1
+#define STOP_WATCHPOINT 2
+#define STOP_INSTRUCTIONS 3
+#define STOP_CONDITION 4
+
+typedef struct {
+	int reason;        // STOP_*
+	int access;        // WATCH_* of a watchpoint
+	uint16_t pc;       // instruction at the breakpoint or that made the access
+	uint16_t address;  // memory address or port accessed
+	uint8_t value;     // value read or written
+} machine_stop;
+
+typedef struct Machine Machine;
+
+// checked by machine_stop_when before each instruction
+typedef bool (*machine_condition)(Machine *machine, uint16_t pc, void *context);
+
+struct Machine {
+	Z80 cpu;
+	scheduler events;
+	uint64_t step_end;
+
+	uint8_t rom[32*1024];
+
+	// the devices, from ram to idle_address, are saved by machine_save
+	uint8_t ram[32*1024];
+
+	uint8_t vram_name[8192];
+	uint8_t vram_attribute[8192];
+	uint8_t vram_pattern[8192];
+	uint8_t vram_palette[8192];
+	uint16_t vram_address;
+
+	bool text_mode;
+	bool zoomX;
+	bool zoomY;
+	uint16_t scrollX;
+	uint16_t scrollY;
+	bool video_dirty;
+
+	uint8_t sio_register_selected_a;
+	uint8_t sio_register_selected_b;
+	uint8_t sio_interrupt_vector;
+
+	bool keyboard_interrupts_enabled;
+	uint8_t keyboard_buffer[MAX_KEY_CODE_LEN];
+	int keyboard_buffer_len;
+	int keyboard_buffer_pos;
+	uint8_t keyboard_pending[MAX_KEY_CODE_LEN];
+	int keyboard_pending_len;
+
+	uint64_t idle_cycles;
+	uint16_t idle_address;
+
+	// called with each byte sent to the serial port; can be NULL
+	void (*serial_out)(Machine *machine, uint8_t value);
+	// called when the ROM enables or disables the keyboard interrupts; can
+	// be NULL
+	void (*keyboard_interrupts)(Machine *machine, bool enabled);
+	void *user_data;
+
+	// the call graph following this machine, see callgraph.h; can be NULL
+	void *call_graph;
+
+	// breakpoints and watchpoints, NULL while there are none
+	void *debug;
+	machine_condition condition;
+	void *condition_context;
+	machine_stop stop;
+};
+
+// Returns NULL if out of memory. The ROM is copied and is at most 32 KiB.
+Machine *machine_create(const uint8_t *rom, size_t rom_size);
+void machine_destroy(Machine *machine);
+
+// Runs the machine for the given number of cycles and returns the number of
+// cycles executed, which can differ by a few cycles; the difference is
+// corrected in the next step. It returns earlier at a breakpoint, after the
+// instruction that hits a watchpoint or where machine_stop_after or
+// machine_stop_when says, with the reason in `stop`; the next step
+// continues from there.
+uint64_t machine_step(Machine *machine, uint64_t cycles);
+
+// Sets or clears an execution breakpoint, which stops the machine before the
+// instruction at `address` runs. Returns false if Z80.c is built without
+// CPU_Z80_WITH_BREAKPOINTS or if out of memory.
+bool machine_break(Machine *machine, uint16_t address, bool set);
+
+// Sets or clears watchpoints on the accesses in `accesses` (WATCH_*) to the
+// addresses or ports `from` to `to`. Ports are matched on their low byte, as
+// the devices decode them. Same results as machine_break. With
+// CPU_Z80_WITH_MEMORY_MAP, memory accesses are watched from the next step on.
+bool machine_watch(Machine *machine, int accesses, uint16_t from, uint16_t to, bool set);
+
+// Clears all breakpoints and watchpoints.
+void machine_clear_points(Machine *machine);
+
+// Stops the machine before it runs the instruction after the next
+// `instructions` ones, not counting interrupts, or cancels that if it is 0.
+// Same results as machine_break.
+bool machine_stop_after(Machine *machine, uint64_t instructions);
+
+// Stops the machine before an instruction when `condition` returns true. It
+// is called before every instruction, with `context`, until canceled with
+// NULL. Same results as machine_break.
+bool machine_stop_when(Machine *machine, machine_condition condition, void *context);
+
+// Size of the buffers of machine_save and machine_load.
+size_t machine_state_size(void);
+
+// Copies the state of the CPU, the event queue and the devices, enough to
+// run again from here with the same results. Call between steps.
+void machine_save(const Machine *machine, void *state);
+
+// Restores a state saved by machine_save from the same machine. The next
+// step starts at its cycle, and the points hit before it are forgotten.
+void machine_load(Machine *machine, const void *state);
+
+// Copies memory as the CPU reads it, wrapping around at 64 KiB, but without
+// the side effects of its reads, for debuggers.
+void machine_peek(const Machine *machine, uint16_t address, uint8_t *data, size_t length);
+
+// Writes memory as the CPU does, so the ROM does not change, but without the
+// side effects of its writes.
+void machine_poke(Machine *machine, uint16_t address, const uint8_t *data, size_t length);
+
+// Sends a PS/2 code to the keyboard port. Returns false if the previous one
+// has not been received yet.
+bool machine_key(Machine *machine, const uint8_t *code, int length);
+
+#endif  // MACHINE_H
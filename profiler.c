@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+
+#define NO_SYMBOL "(no symbol)"
+
+typedef struct {
+	const char *name;
+	uint64_t samples;
+} entry;
+
+static void sample(void *context, uint64_t cycle) {
+	profile *p = context;
+	p->samples[p->machine->cpu.state.Z_Z80_STATE_MEMBER_PC]++;
+	p->total++;
+	scheduler_add(&p->machine->events, cycle + p->period, sample, p);
+}
+
+void profile_init(profile *p, uint64_t period) {
+	memset(p, 0, sizeof(*p));
+	p->period = period ? period : 1;
+}
+
+void profile_free(profile *p) {
+	profile_detach(p);
+}
+
+bool profile_attach(profile *p, Machine *machine) {
+	profile_detach(p);
+	p->machine = machine;
+	return scheduler_add(&machine->events, scheduler_now(&machine->events) + p->period, sample, p);
+}
+
+void profile_detach(profile *p) {
+	if (p->machine == NULL) return;
+	scheduler_remove(&p->machine->events, sample, p);
+	p->machine = NULL;
+}
+
+void profile_add(profile *p, const profile *from) {
+	for (int i = 0; i < 65536; i++) {
+		p->samples[i] += from->samples[i];
+	}
+	p->total += from->total;
+}
+
+static int compare_entries(const void *a, const void *b) {
+	const entry *x = a, *y = b;
+	if (x->samples != y->samples) return x->samples > y->samples ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+// Samples per function, sorted with the most sampled first. Addresses map to
+// functions in increasing order, so each function is one run of addresses.
+static int functions(const profile *p, const symbol_table *symbols, entry **result) {
+	entry *list = calloc(symbols->count + 1, sizeof(entry));
+	int count = 0, current = -2;
+
+	for (int address = 0; address < 65536; address++) {
+		if (p->samples[address] == 0) continue;
+		int function = symbols_find(symbols, address, true);
+		if (function != current) {
+			list[count++] = (entry){function < 0 ? NO_SYMBOL : symbols->symbols[function].name, 0};
+			current = function;
+		}
+		list[count - 1].samples += p->samples[address];
+	}
+	qsort(list, count, sizeof(entry), compare_entries);
+	*result = list;
+	return count;
+}
+
+static double percent(const profile *p, uint64_t samples) {
+	return p->total ? 100.0 * samples / p->total : 0;
+}
+
+void profile_report(const profile *p, const symbol_table *symbols, FILE *file, int lines) {
+	entry *list;
+	int count = functions(p, symbols, &list);
+
+	fprintf(file, "%llu samples, one every %llu cycles\n\nfunctions:\n",
+		(unsigned long long)p->total, (unsigned long long)p->period);
+	for (int i = 0; i < count && i < lines; i++) {
+		fprintf(file, "%7.2f%% %10llu  %s\n", percent(p, list[i].samples), (unsigned long long)list[i].samples, list[i].name);
+	}
+	free(list);
+
+	// the most sampled addresses, by selection since only a few are printed
+	uint16_t *addresses = malloc(65536 * sizeof(uint16_t));
+	int used = 0;
+	for (int address = 0; address < 65536; address++) {
+		if (p->samples[address]) addresses[used++] = address;
+	}
+	fputs("\naddresses:\n", file);
+	for (int i = 0; i < used && i < lines; i++) {
+		int best = i;
+		for (int j = i + 1; j < used; j++) {
+			if (p->samples[addresses[j]] > p->samples[addresses[best]]) best = j;
+		}
+		uint16_t address = addresses[best];
+		addresses[best] = addresses[i];
+		addresses[i] = address;
+
+		int label = symbols_find(symbols, address, false);
+		fprintf(file, "%7.2f%% %10llu  $%.4X", percent(p, p->samples[address]),
+			(unsigned long long)p->samples[address], address);
+		if (label >= 0) {
+			const symbol *s = &symbols->symbols[label];
+			fprintf(file, "  %s", s->name);
+			if (address != s->address) fprintf(file, "+%d", address - s->address);
+		}
+		fputc('\n', file);
+	}
+	free(addresses);
+}
+
+bool profile_write_flat(const profile *p, const symbol_table *symbols, const char *path) {
+	entry *list;
+	int count = functions(p, symbols, &list);
+	uint64_t cumulative = 0;
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		free(list);
+		return false;
+	}
+
+	fprintf(file, "Flat profile: %llu samples, one every %llu cycles.\n\n",
+		(unsigned long long)p->total, (unsigned long long)p->period);
+	fprintf(file, "  %%   cumulative       self\n");
+	fprintf(file, " time     samples    samples  name\n");
+	for (int i = 0; i < count; i++) {
+		cumulative += list[i].samples;
+		fprintf(file, "%6.2f %11llu %10llu  %s\n", percent(p, list[i].samples),
+			(unsigned long long)cumulative, (unsigned long long)list[i].samples, list[i].name);
+	}
+	free(list);
+	return fclose(file) == 0;
+}
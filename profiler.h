@@ -0,0 +1,38 @@
+// Sampling profiler: records the PC of a machine every `period` emulated
+// cycles, from a scheduler event, and reports the samples per address and
+// per function of the ROM's symbol table.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "machine.h"
+#include "symbols.h"
+
+typedef struct {
+	uint64_t period;
+	uint64_t total;
+	uint64_t samples[65536];  // per address
+
+	Machine *machine;  // being sampled, if any
+} profile;
+
+void profile_init(profile *p, uint64_t period);
+void profile_free(profile *p);
+
+// Starts sampling a machine. Only one profile can sample a machine.
+bool profile_attach(profile *p, Machine *machine);
+void profile_detach(profile *p);
+
+// Adds the samples of `from` to `p`.
+void profile_add(profile *p, const profile *from);
+
+// Writes the functions and addresses with most samples, `lines` of each.
+void profile_report(const profile *p, const symbol_table *symbols, FILE *file, int lines);
+
+// Writes every function with samples, in the style of a gprof flat profile.
+bool profile_write_flat(const profile *p, const symbol_table *symbols, const char *path);
+
+#endif  // PROFILER_H
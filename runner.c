@@ -0,0 +1,796 @@
+// Headless batch runner: runs many machines on all cores and writes one
+// result file.
+//
+//   runner [-H HISTOGRAM] [-P PROFILE] [-p PERIOD] [-F FOLDED] [-S SYMBOLS]
+//          [-T PREFIX [-r]] [-C COVERAGE [-L LISTING]] [-W POINT]... [-U POINT]...
+//          MANIFEST RESULTS [THREADS]
+//
+// Each manifest line is a job: ROM CYCLES [INPUT [EXPECTED]], where INPUT is
+// an input script and EXPECTED a file with the expected serial output ("-"
+// for none). Input script lines are CYCLE BYTE..., a PS/2 code in hex sent to
+// the keyboard at that cycle. Blank lines and lines starting with # are
+// ignored in both files.
+//
+// Results are written as JSON lines, in manifest order.
+//
+// With -H, and Z80.c built with CPU_Z80_WITH_HISTOGRAM, the opcode counts of
+// all jobs are added up and written to HISTOGRAM, as JSON if its name ends in
+// .json and as CSV otherwise. Their cycles, with those taken to accept the
+// interrupts, add up to the cycles run.
+//
+// With -P, the PC of every job is sampled every PERIOD emulated cycles (1000
+// by default), the hottest functions and addresses are printed and a flat
+// profile is written to PROFILE.
+//
+// With -F, and Z80.c built with CPU_Z80_WITH_CALL_HOOKS, the cycles of every
+// job are added up per call path, the paths with most inclusive cycles are
+// printed and all of them are written to FOLDED as folded stacks, the input
+// of flame graph tools.
+//
+// The profiles name functions after the SYMBOLS file of the ROM, if given.
+//
+// With -T, and Z80.c built with CPU_Z80_WITH_TRACE, each job writes a binary
+// trace of its instructions and accesses to PREFIX followed by its manifest
+// line number and .trace, with the changed registers too if -r is given. See
+// trace-decode.c to read them.
+//
+// With -C, and Z80.c built with CPU_Z80_WITH_COVERAGE, the addresses executed
+// and read as data by all jobs are added to the bitmaps in the COVERAGE file,
+// which is created if needed, and written as text to COVERAGE.map. With -L,
+// the LISTING of the ROM is also copied to COVERAGE.lst with a coverage column.
+//
+// With -W, and Z80.c built with CPU_Z80_WITH_BREAKPOINTS, every job prints a
+// line when it reaches a POINT and goes on. A POINT is x:ADDRESS for an
+// execution breakpoint, r, w, i or o (memory read or write, port in or out)
+// followed by :FROM or :FROM-TO in hex for a watchpoint, or n:COUNT for the
+// instruction after the first COUNT, in decimal. With -U, every job also ends
+// at the first POINT of those it reaches, with the reason in "stop" and the
+// cycles run until there in "cycles".
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "callgraph.h"
+#include "coverage.h"
+#include "machine.h"
+#include "profiler.h"
+#include "trace.h"
+
+#define MAX_PATH_LEN 1024
+#define MAX_KEYS 4096
+#define MAX_POINTS 64
+
+typedef struct {
+	uint64_t cycle;
+	uint8_t code[MAX_KEY_CODE_LEN];
+	int length;
+} key;
+
+typedef struct {
+	int line;
+	char rom[MAX_PATH_LEN];
+	char input[MAX_PATH_LEN];
+	char expected[MAX_PATH_LEN];
+	uint64_t cycles;
+
+	// results
+	const char *status;
+	char error[128];
+	char *output;
+	size_t output_len;
+	size_t output_capacity;
+	uint64_t cycles_run;
+	char stop[64];  // the -U point that ended it, if any
+	uint64_t ram_hash;
+	uint64_t vram_hash;
+	double seconds;
+#ifdef CPU_Z80_WITH_HISTOGRAM
+	Z80Histogram *histogram;
+#endif
+} job;
+
+// Each worker owns a deque of job indices: it takes work from the bottom and
+// other workers steal from the top when their own deque is empty.
+typedef struct {
+	pthread_mutex_t lock;
+	int *jobs;
+	int top;
+	int bottom;
+} deque;
+
+typedef struct {
+	job *jobs;
+	deque *deques;
+	int workers;
+} pool;
+
+// the samples and call paths of every job are added to these, if profiling
+static profile *profiled;
+static call_graph *calls;
+static pthread_mutex_t profiled_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// each job is traced to a file that starts with this, if tracing
+static const char *trace_prefix;
+static bool trace_registers;
+
+#ifdef CPU_Z80_WITH_COVERAGE
+// the coverage of every job is added to this, if measuring it
+static Z80Coverage *covered;
+#endif
+
+// the breakpoints, watchpoints and instruction counts set in every job
+typedef struct {
+	int accesses;  // WATCH_*, or 0 for a breakpoint or a count
+	uint16_t from;
+	uint16_t to;
+	uint64_t instructions;  // of a count, 0 otherwise
+	bool until;  // ends the job, from -U
+} point;
+static point points[MAX_POINTS];
+static int point_count;
+
+typedef struct {
+	pool *pool;
+	int index;
+} worker;
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static double now_seconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// For the setup of main, which has nothing to do without the memory
+static void *allocate(size_t count, size_t size) {
+	void *memory = calloc(count, size);
+	if (memory == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(2);
+	}
+	return memory;
+}
+
+// Returns false with errno set if the file can not be read or does not fit
+// in memory
+static bool read_file(const char *path, uint8_t **data, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	size_t capacity = 4096;
+	if (file == NULL) return false;
+	uint8_t *bytes = malloc(capacity);
+	*size = 0;
+	while (bytes) {
+		if (*size == capacity) {
+			uint8_t *more = realloc(bytes, capacity *= 2);
+			if (more == NULL) {
+				free(bytes);
+				bytes = NULL;
+				break;
+			}
+			bytes = more;
+		}
+		size_t n = fread(bytes + *size, 1, capacity - *size, file);
+		if (n == 0) break;
+		*size += n;
+	}
+	fclose(file);
+	*data = bytes;
+	return bytes != NULL;
+}
+
+// The output that does not fit in memory is dropped and fails the job
+static void serial_out(Machine *machine, uint8_t value) {
+	job *j = machine->user_data;
+	if (j->output_len == j->output_capacity) {
+		size_t capacity = j->output_capacity ? j->output_capacity * 2 : 256;
+		char *output = realloc(j->output, capacity);
+		if (output == NULL) {
+			j->status = "error";
+			snprintf(j->error, sizeof(j->error), "out of memory for the output");
+			return;
+		}
+		j->output = output;
+		j->output_capacity = capacity;
+	}
+	j->output[j->output_len++] = value;
+}
+
+static int load_input(job *j, key *keys) {
+	char line[1024];
+	int count = 0;
+	FILE *file = fopen(j->input, "r");
+	if (file == NULL) return -1;
+	while (fgets(line, sizeof(line), file) && count < MAX_KEYS) {
+		char *p = line;
+		unsigned long long cycle;
+		int n;
+		if (sscanf(p, " %llu%n", &cycle, &n) != 1) continue;
+		p += n;
+		keys[count].cycle = cycle;
+		keys[count].length = 0;
+		unsigned int byte;
+		while (keys[count].length < MAX_KEY_CODE_LEN && sscanf(p, " %x%n", &byte, &n) == 1) {
+			keys[count].code[keys[count].length++] = byte;
+			p += n;
+		}
+		if (keys[count].length) count++;
+	}
+	fclose(file);
+	return count;
+}
+
+static bool parse_point(const char *text, bool until, point *p) {
+	static const char kinds[] = "xrwio";
+	static const int accesses[] = {0, WATCH_READ, WATCH_WRITE, WATCH_IN, WATCH_OUT};
+	unsigned from, to;
+	int n = 0;
+	if (text[0] == 'n' && text[1] == ':') {
+		// a machine counts down to one stop only
+		unsigned long long count;
+		for (int i = 0; i < point_count; i++) {
+			if (points[i].instructions) return false;
+		}
+		if (sscanf(text + 2, "%llu%n", &count, &n) != 1 || text[2 + n] || count == 0) return false;
+		*p = (point){0, 0, 0, count, until};
+		return true;
+	}
+	const char *kind = strchr(kinds, text[0]);
+	if (kind == NULL || !*kind || text[1] != ':') return false;
+	if (sscanf(text + 2, "%x%n", &from, &n) != 1) return false;
+	to = from;
+	if (text[2 + n] == '-' && *kind != 'x') {
+		int m = 0;
+		if (sscanf(text + 3 + n, "%x%n", &to, &m) != 1) return false;
+		n += 1 + m;
+	}
+	if (text[2 + n] || from > to || to > 0xFFFF) return false;
+	*p = (point){accesses[kind - kinds], from, to, 0, until};
+	return true;
+}
+
+static void describe_stop(const machine_stop *s, char *text, size_t size) {
+	static const char *const names[] = {"", "read", "write", "", "in", "", "", "", "out"};
+	if (s->reason == STOP_BREAKPOINT) {
+		snprintf(text, size, "breakpoint at %.4X", s->pc);
+	} else if (s->reason == STOP_INSTRUCTIONS) {
+		snprintf(text, size, "instruction count at %.4X", s->pc);
+	} else {
+		snprintf(text, size, "%s %.4X = %.2X by %.4X", names[s->access], s->address, s->value, s->pc);
+	}
+}
+
+// Whether the stop is at a point given with -U; ports match on their low byte
+static bool is_until(const machine_stop *s) {
+	for (int i = 0; i < point_count; i++) {
+		const point *p = &points[i];
+		int address = s->access & (WATCH_IN | WATCH_OUT) ? s->address & 0xFF : s->address;
+		if (!p->until) continue;
+		if (s->reason == STOP_INSTRUCTIONS && p->instructions) return true;
+		if (s->reason == STOP_BREAKPOINT && !p->accesses && !p->instructions && s->pc == p->from) return true;
+		if (s->reason == STOP_WATCHPOINT && (s->access & p->accesses) && address >= p->from && address <= p->to) return true;
+	}
+	return false;
+}
+
+// Runs a machine_step of a job, going on after the points hit on the way,
+// unless one ends the job
+static uint64_t step(job *j, Machine *m, uint64_t cycles) {
+	uint64_t done = 0;
+	for (;;) {
+		char text[sizeof(j->stop)];
+		done += machine_step(m, cycles - done);
+		if (m->stop.reason == STOP_NONE) return done;
+		describe_stop(&m->stop, text, sizeof(text));
+		fprintf(stderr, "job %d, cycle %llu: %s\n", j->line, (unsigned long long)scheduler_now(&m->events), text);
+		if (is_until(&m->stop)) {
+			snprintf(j->stop, sizeof(j->stop), "%s", text);
+			return done;
+		}
+		if (done >= cycles) return done;
+	}
+}
+
+static void run_job(job *j) {
+	static const char none[] = "-";
+	uint8_t *rom;
+	size_t rom_size;
+	key *keys = malloc(MAX_KEYS * sizeof(key));
+	int key_count = 0;
+	double start = now_seconds();
+
+	if (keys == NULL) {
+		j->status = "error";
+		snprintf(j->error, sizeof(j->error), "out of memory");
+		return;
+	}
+	if (!read_file(j->rom, &rom, &rom_size)) {
+		j->status = "error";
+		snprintf(j->error, sizeof(j->error), "can not read ROM: %s", strerror(errno));
+		free(keys);
+		return;
+	}
+	if (*j->input && strcmp(j->input, none) && (key_count = load_input(j, keys)) < 0) {
+		j->status = "error";
+		snprintf(j->error, sizeof(j->error), "can not read input: %s", strerror(errno));
+		free(keys);
+		free(rom);
+		return;
+	}
+
+	Machine *m = machine_create(rom, rom_size);
+	free(rom);
+	if (m == NULL) {
+		j->status = "error";
+		snprintf(j->error, sizeof(j->error), "out of memory");
+		free(keys);
+		return;
+	}
+	m->serial_out = serial_out;
+	m->user_data = j;
+#ifdef CPU_Z80_WITH_HISTOGRAM
+	m->cpu.histogram = j->histogram;
+#endif
+	profile *samples = NULL;
+	if (profiled) {
+		if ((samples = malloc(sizeof(profile))) != NULL) {
+			profile_init(samples, profiled->period);
+			profile_attach(samples, m);
+		} else {
+			j->status = "error";
+			snprintf(j->error, sizeof(j->error), "out of memory for the profile");
+		}
+	}
+	call_graph *paths = NULL;
+	if (calls) {
+		if ((paths = malloc(sizeof(call_graph))) != NULL) {
+			call_graph_init(paths);
+			call_graph_attach(paths, m);
+		} else {
+			j->status = "error";
+			snprintf(j->error, sizeof(j->error), "out of memory for the call graph");
+		}
+	}
+#ifdef CPU_Z80_WITH_COVERAGE
+	if (covered && (m->cpu.coverage = calloc(1, sizeof(Z80Coverage))) == NULL) {
+		j->status = "error";
+		snprintf(j->error, sizeof(j->error), "out of memory for the coverage");
+	}
+#endif
+	for (int i = 0; i < point_count; i++) {
+		if (points[i].instructions) machine_stop_after(m, points[i].instructions);
+		else if (points[i].accesses) machine_watch(m, points[i].accesses, points[i].from, points[i].to, true);
+		else machine_break(m, points[i].from, true);
+	}
+#ifdef CPU_Z80_WITH_TRACE
+	tracer *trace = NULL;
+	if (trace_prefix) {
+		char path[MAX_PATH_LEN];
+		snprintf(path, sizeof(path), "%s%d.trace", trace_prefix, j->line);
+		trace = malloc(sizeof(tracer));
+		if (trace == NULL || !tracer_start(trace, &m->cpu, path, trace_registers)) {
+			j->status = "error";
+			snprintf(j->error, sizeof(j->error), "can not write trace: %s", strerror(errno));
+			free(trace);
+			trace = NULL;
+		}
+	}
+#endif
+
+	// a key that finds the previous one still in transit waits for it
+	uint64_t now = 0;
+	for (int k = 0; k < key_count && now < j->cycles && !*j->stop; ) {
+		if (keys[k].cycle > now) {
+			uint64_t until = keys[k].cycle < j->cycles ? keys[k].cycle : j->cycles;
+			now += step(j, m, until - now);
+		} else if (machine_key(m, keys[k].code, keys[k].length)) {
+			k++;
+		} else {
+			now += step(j, m, CYCLES_PER_FRAME / 100);
+		}
+	}
+	if (now < j->cycles && !*j->stop) now += step(j, m, j->cycles - now);
+
+	j->cycles_run = now;
+	j->ram_hash = fnv1a(14695981039346656037ULL, m->ram, sizeof(m->ram));
+	j->vram_hash = fnv1a(14695981039346656037ULL, m->vram_name, sizeof(m->vram_name));
+	j->vram_hash = fnv1a(j->vram_hash, m->vram_attribute, sizeof(m->vram_attribute));
+	j->vram_hash = fnv1a(j->vram_hash, m->vram_pattern, sizeof(m->vram_pattern));
+	j->vram_hash = fnv1a(j->vram_hash, m->vram_palette, sizeof(m->vram_palette));
+#ifdef CPU_Z80_WITH_TRACE
+	if (trace) {
+		if (!tracer_stop(trace)) {
+			j->status = "error";
+			snprintf(j->error, sizeof(j->error), "can not write trace");
+		}
+		free(trace);
+	}
+#endif
+#ifdef CPU_Z80_WITH_COVERAGE
+	if (m->cpu.coverage) {
+		pthread_mutex_lock(&profiled_lock);
+		coverage_add(covered, m->cpu.coverage);
+		pthread_mutex_unlock(&profiled_lock);
+		free(m->cpu.coverage);
+	}
+#endif
+	if (samples || paths) {
+		pthread_mutex_lock(&profiled_lock);
+		if (samples) profile_add(profiled, samples);
+		if (paths) {
+			call_graph_detach(paths);
+			call_graph_add(calls, paths);
+		}
+		pthread_mutex_unlock(&profiled_lock);
+	}
+	if (samples) {
+		profile_free(samples);
+		free(samples);
+	}
+	if (paths) {
+		call_graph_free(paths);
+		free(paths);
+	}
+	machine_destroy(m);
+	free(keys);
+
+	if (*j->error) return;
+	j->status = "done";
+	if (*j->expected && strcmp(j->expected, none)) {
+		uint8_t *expected;
+		size_t expected_size;
+		if (!read_file(j->expected, &expected, &expected_size)) {
+			j->status = "error";
+			snprintf(j->error, sizeof(j->error), "can not read expected output: %s", strerror(errno));
+		} else {
+			bool same = expected_size == j->output_len && !memcmp(expected, j->output, expected_size);
+			j->status = same ? "pass" : "fail";
+			free(expected);
+		}
+	}
+	j->seconds = now_seconds() - start;
+}
+
+static int take(deque *d, bool steal) {
+	int index = -1;
+	pthread_mutex_lock(&d->lock);
+	if (d->top < d->bottom) {
+		index = steal ? d->jobs[d->top++] : d->jobs[--d->bottom];
+	}
+	pthread_mutex_unlock(&d->lock);
+	return index;
+}
+
+static void *work(void *argument) {
+	worker *w = argument;
+	pool *p = w->pool;
+	for (;;) {
+		int index = take(&p->deques[w->index], false);
+		for (int i = 1; index < 0 && i < p->workers; i++) {
+			index = take(&p->deques[(w->index + i) % p->workers], true);
+		}
+		// jobs never create jobs, so once every deque is empty the work is done
+		if (index < 0) return NULL;
+		run_job(&p->jobs[index]);
+	}
+}
+
+static int load_manifest(const char *path, job **jobs) {
+	char line[4 * MAX_PATH_LEN];
+	int count = 0, capacity = 0, number = 0;
+	FILE *file = fopen(path, "r");
+	if (file == NULL) return -1;
+	*jobs = NULL;
+	while (fgets(line, sizeof(line), file)) {
+		job j = {0};
+		unsigned long long cycles;
+		number++;
+		if (sscanf(line, " %1023s %llu %1023s %1023s", j.rom, &cycles, j.input, j.expected) < 2 || *j.rom == '#') continue;
+		j.line = number;
+		j.cycles = cycles;
+		if (count == capacity) {
+			job *more = realloc(*jobs, (capacity = capacity ? capacity * 2 : 64) * sizeof(job));
+			if (more == NULL) {
+				free(*jobs);
+				fclose(file);
+				return -1;
+			}
+			*jobs = more;
+		}
+		(*jobs)[count++] = j;
+	}
+	fclose(file);
+	return count;
+}
+
+static void write_string(FILE *file, const char *data, size_t size) {
+	fputc('"', file);
+	for (size_t i = 0; i < size; i++) {
+		unsigned char c = data[i];
+		if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+		else if (c == '\n') fputs("\\n", file);
+		else if (c < 0x20 || c >= 0x7F) fprintf(file, "\\u%.4x", c);
+		else fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+static void write_result(FILE *file, const job *j) {
+	fprintf(file, "{\"line\": %d, \"rom\": ", j->line);
+	write_string(file, j->rom, strlen(j->rom));
+	fprintf(file, ", \"status\": \"%s\"", j->status);
+	if (*j->error) {
+		fputs(", \"error\": ", file);
+		write_string(file, j->error, strlen(j->error));
+	} else {
+		fprintf(file, ", \"cycles\": %llu, \"seconds\": %.6f, \"mhz\": %.1f",
+			(unsigned long long)j->cycles_run, j->seconds, j->cycles_run / (j->seconds * 1e6));
+		fprintf(file, ", \"ram_hash\": \"%.16llx\", \"vram_hash\": \"%.16llx\", \"output\": ",
+			(unsigned long long)j->ram_hash, (unsigned long long)j->vram_hash);
+		write_string(file, j->output ? j->output : "", j->output_len);
+		if (*j->stop) {
+			fputs(", \"stop\": ", file);
+			write_string(file, j->stop, strlen(j->stop));
+		}
+	}
+	fputs("}\n", file);
+}
+
+#ifdef CPU_Z80_WITH_HISTOGRAM
+
+static const char *const table_names[] = {"", "CB", "ED", "XY", "XYCB"};
+static const char *const interrupt_names[] = {"im0", "im1", "im2", "nmi"};
+
+static bool write_histogram(const char *path, const Z80Histogram *h) {
+	const char *extension = strrchr(path, '.');
+	bool json = extension && !strcmp(extension, ".json");
+	uint64_t interrupts[4] = {h->int_count[0], h->int_count[1], h->int_count[2], h->nmi_count};
+	const char *separator = "";
+	FILE *file = fopen(path, "w");
+	if (file == NULL) return false;
+
+	fputs(json ? "{\"opcodes\": [" : "table,opcode,count,cycles\n", file);
+	for (int t = 0; t < 5; t++) {
+		for (int i = 0; i < 256; i++) {
+			if (h->count[t][i] == 0) continue;
+			fprintf(file, json
+				? "%s\n{\"table\": \"%s\", \"opcode\": \"%.2X\", \"count\": %llu, \"cycles\": %llu}"
+				: "%s%s,%.2X,%llu,%llu\n",
+				separator, table_names[t], i,
+				(unsigned long long)h->count[t][i], (unsigned long long)h->cycles[t][i]);
+			if (json) separator = ",";
+		}
+	}
+	if (json) fputs("\n], \"interrupts\": {", file);
+	for (int i = 0; i < 4; i++) {
+		if (json) fprintf(file, "%s\"%s\": %llu", i ? ", " : "", interrupt_names[i], (unsigned long long)interrupts[i]);
+		else fprintf(file, "interrupt,%s,%llu,\n", interrupt_names[i], (unsigned long long)interrupts[i]);
+	}
+	if (json) fprintf(file, "}, \"interrupt_cycles\": %llu}\n", (unsigned long long)h->interrupt_cycles);
+	else fprintf(file, "interrupt,,%llu,%llu\n", (unsigned long long)(interrupts[0] + interrupts[1] + interrupts[2] + interrupts[3]), (unsigned long long)h->interrupt_cycles);
+	return fclose(file) == 0;
+}
+
+#endif
+
+int main(int argc, char *argv[]) {
+	job *jobs;
+	int count, workers, failed = 0, option;
+	const char *histogram = NULL, *flat = NULL, *folded = NULL, *symbols = NULL, *program = argv[0];
+	const char *coverage = NULL, *listing = NULL;
+	uint64_t period = 1000;
+	symbol_table table = {0};
+
+	while ((option = getopt(argc, argv, "H:P:F:S:T:C:L:W:U:p:r")) != -1) {
+		switch (option) {
+		case 'H': histogram = optarg; break;
+		case 'P': flat = optarg; break;
+		case 'F': folded = optarg; break;
+		case 'S': symbols = optarg; break;
+		case 'T': trace_prefix = optarg; break;
+		case 'C': coverage = optarg; break;
+		case 'L': listing = optarg; break;
+		case 'W':
+		case 'U':
+			if (point_count == MAX_POINTS || !parse_point(optarg, option == 'U', &points[point_count++])) {
+				fprintf(stderr, "bad or too many points: %s\n", optarg);
+				return 2;
+			}
+			break;
+		case 'p': period = strtoull(optarg, NULL, 0); break;
+		case 'r': trace_registers = true; break;
+		default: return 2;
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s [-H HISTOGRAM] [-P PROFILE] [-p PERIOD] [-F FOLDED] [-S SYMBOLS]\n"
+			"       [-T PREFIX [-r]] [-C COVERAGE [-L LISTING]] [-W POINT]... [-U POINT]... MANIFEST RESULTS [THREADS]\n", program);
+		return 2;
+	}
+#ifndef CPU_Z80_WITH_HISTOGRAM
+	if (histogram) {
+		fprintf(stderr, "-H needs a build with -DCPU_Z80_WITH_HISTOGRAM\n");
+		return 2;
+	}
+#endif
+#ifndef CPU_Z80_WITH_CALL_HOOKS
+	if (folded) {
+		fprintf(stderr, "-F needs a build with -DCPU_Z80_WITH_CALL_HOOKS\n");
+		return 2;
+	}
+#endif
+#ifndef CPU_Z80_WITH_TRACE
+	if (trace_prefix) {
+		fprintf(stderr, "-T needs a build with -DCPU_Z80_WITH_TRACE\n");
+		return 2;
+	}
+#endif
+#ifndef CPU_Z80_WITH_BREAKPOINTS
+	if (point_count) {
+		fprintf(stderr, "-W and -U need a build with -DCPU_Z80_WITH_BREAKPOINTS\n");
+		return 2;
+	}
+#endif
+#ifdef CPU_Z80_WITH_COVERAGE
+	if (coverage) covered = allocate(1, sizeof(Z80Coverage));
+#else
+	if (coverage || listing) {
+		fprintf(stderr, "-C needs a build with -DCPU_Z80_WITH_COVERAGE\n");
+		return 2;
+	}
+#endif
+	if ((count = load_manifest(argv[1], &jobs)) < 0) {
+		fprintf(stderr, "can not read %s: %s\n", argv[1], strerror(errno));
+		return 2;
+	}
+	if (symbols && !symbols_load(&table, symbols)) {
+		fprintf(stderr, "can not read %s: %s\n", symbols, strerror(errno));
+		return 2;
+	}
+	if (flat) {
+		profiled = allocate(1, sizeof(profile));
+		profile_init(profiled, period);
+	}
+	if (folded) {
+		calls = allocate(1, sizeof(call_graph));
+		call_graph_init(calls);
+	}
+	workers = argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers < 1) workers = 1;
+#ifdef CPU_Z80_WITH_HISTOGRAM
+	for (int i = 0; histogram && i < count; i++) {
+		jobs[i].histogram = allocate(1, sizeof(Z80Histogram));
+	}
+#endif
+
+	pool p = {jobs, allocate(workers, sizeof(deque)), workers};
+	pthread_t *threads = allocate(workers, sizeof(pthread_t));
+	worker *w = allocate(workers, sizeof(worker));
+	for (int i = 0; i < workers; i++) {
+		pthread_mutex_init(&p.deques[i].lock, NULL);
+		p.deques[i].jobs = allocate(count / workers + 1, sizeof(int));
+	}
+	for (int i = 0; i < count; i++) {
+		deque *d = &p.deques[i % workers];
+		d->jobs[d->bottom++] = i;
+	}
+
+	// the jobs of a worker that can not start are stolen by the others
+	double start = now_seconds();
+	int started = 0, error = 0;
+	for (int i = 0; i < workers && !error; i++) {
+		w[i] = (worker){&p, i};
+		if ((error = pthread_create(&threads[i], NULL, work, &w[i])) == 0) started++;
+	}
+	if (started == 0) {
+		fprintf(stderr, "can not start a worker thread: %s\n", strerror(error));
+		return 2;
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	double seconds = now_seconds() - start;
+
+	FILE *results = fopen(argv[2], "w");
+	if (results == NULL) {
+		fprintf(stderr, "can not write %s: %s\n", argv[2], strerror(errno));
+		return 2;
+	}
+	uint64_t total_cycles = 0;
+	for (int i = 0; i < count; i++) {
+		write_result(results, &jobs[i]);
+		total_cycles += jobs[i].cycles_run;
+		failed += strcmp(jobs[i].status, "fail") == 0 || strcmp(jobs[i].status, "error") == 0;
+		free(jobs[i].output);
+	}
+	fclose(results);
+
+#ifdef CPU_Z80_WITH_HISTOGRAM
+	if (histogram) {
+		Z80Histogram *total = allocate(1, sizeof(Z80Histogram));
+		for (int i = 0; i < count; i++) {
+			for (int t = 0; t < 5; t++) {
+				for (int k = 0; k < 256; k++) {
+					total->count[t][k] += jobs[i].histogram->count[t][k];
+					total->cycles[t][k] += jobs[i].histogram->cycles[t][k];
+				}
+			}
+			for (int k = 0; k < 3; k++) {
+				total->int_count[k] += jobs[i].histogram->int_count[k];
+			}
+			total->nmi_count += jobs[i].histogram->nmi_count;
+			total->interrupt_cycles += jobs[i].histogram->interrupt_cycles;
+			free(jobs[i].histogram);
+		}
+		if (!write_histogram(histogram, total)) {
+			fprintf(stderr, "can not write %s: %s\n", histogram, strerror(errno));
+			return 2;
+		}
+		free(total);
+	}
+#endif
+
+	if (profiled) {
+		profile_report(profiled, &table, stderr, 20);
+		if (!profile_write_flat(profiled, &table, flat)) {
+			fprintf(stderr, "can not write %s: %s\n", flat, strerror(errno));
+			return 2;
+		}
+		profile_free(profiled);
+		free(profiled);
+	}
+	if (calls) {
+		call_graph_totals(calls);
+		call_graph_report(calls, &table, stderr, 20);
+		if (!call_graph_write_folded(calls, &table, folded)) {
+			fprintf(stderr, "can not write %s: %s\n", folded, strerror(errno));
+			return 2;
+		}
+		call_graph_free(calls);
+		free(calls);
+	}
+	symbols_free(&table);
+
+#ifdef CPU_Z80_WITH_COVERAGE
+	if (covered) {
+		char path[MAX_PATH_LEN];
+		int executed, data;
+		if (!coverage_load(covered, coverage)) {
+			fprintf(stderr, "can not read %s\n", coverage);
+			return 2;
+		}
+		coverage_count(covered, 0x0000, 0x7FFF, &executed, &data);
+		fprintf(stderr, "ROM coverage: %d instructions executed, %d bytes read as data\n", executed, data);
+		if (!coverage_save(covered, coverage)) {
+			fprintf(stderr, "can not write %s: %s\n", coverage, strerror(errno));
+			return 2;
+		}
+		snprintf(path, sizeof(path), "%s.map", coverage);
+		if (!coverage_write_map(covered, path)) {
+			fprintf(stderr, "can not write %s: %s\n", path, strerror(errno));
+			return 2;
+		}
+		snprintf(path, sizeof(path), "%s.lst", coverage);
+		if (listing && !coverage_annotate(covered, listing, path)) {
+			fprintf(stderr, "can not annotate %s as %s: %s\n", listing, path, strerror(errno));
+			return 2;
+		}
+		free(covered);
+	}
+#endif
+
+	fprintf(stderr, "%d jobs, %d failed, %d threads, %.2f s, %.1f emulated MHz\n",
+		count, failed, workers, seconds, total_cycles / (seconds * 1e6));
+	return failed != 0;
+}
@@ -0,0 +1,92 @@
+#include "scheduler.h"
+
+static void swap(event *a, event *b) {
+	event t = *a;
+	*a = *b;
+	*b = t;
+}
+
+static void sift_up(scheduler *s, int i) {
+	while (i > 0 && s->heap[(i - 1) / 2].cycle > s->heap[i].cycle) {
+		swap(&s->heap[(i - 1) / 2], &s->heap[i]);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sift_down(scheduler *s, int i) {
+	for (;;) {
+		int smallest = i;
+		int left = 2 * i + 1;
+		int right = left + 1;
+		if (left < s->count && s->heap[left].cycle < s->heap[smallest].cycle) smallest = left;
+		if (right < s->count && s->heap[right].cycle < s->heap[smallest].cycle) smallest = right;
+		if (smallest == i) return;
+		swap(&s->heap[smallest], &s->heap[i]);
+		i = smallest;
+	}
+}
+
+static event pop(scheduler *s) {
+	event first = s->heap[0];
+	s->heap[0] = s->heap[--s->count];
+	sift_down(s, 0);
+	return first;
+}
+
+void scheduler_init(scheduler *s, Z80 *cpu) {
+	s->cpu = cpu;
+	s->cycles = 0;
+	s->running = false;
+	s->stopped = false;
+	s->count = 0;
+}
+
+uint64_t scheduler_now(const scheduler *s) {
+	return s->running ? s->cycles + s->cpu->cycles : s->cycles;
+}
+
+bool scheduler_add(scheduler *s, uint64_t cycle, event_handler handler, void *context) {
+	if (s->count == MAX_EVENTS) return false;
+
+	s->heap[s->count] = (event){cycle, handler, context};
+	sift_up(s, s->count++);
+
+	// make z80_run return at the first instruction boundary at or after it
+	if (s->running && cycle < s->cycles + s->cpu->cycle_limit) {
+		s->cpu->cycle_limit = cycle > scheduler_now(s) ? cycle - s->cycles : s->cpu->cycles;
+	}
+	return true;
+}
+
+void scheduler_remove(scheduler *s, event_handler handler, void *context) {
+	int kept = 0;
+	for (int i = 0; i < s->count; i++) {
+		if (s->heap[i].handler != handler || s->heap[i].context != context) s->heap[kept++] = s->heap[i];
+	}
+	s->count = kept;
+	for (int i = kept / 2 - 1; i >= 0; i--) sift_down(s, i);
+}
+
+void scheduler_run(scheduler *s, uint64_t until) {
+	s->stopped = false;
+	while (s->cycles < until && !s->stopped) {
+		uint64_t deadline = until;
+		if (s->count && s->heap[0].cycle < deadline) deadline = s->heap[0].cycle;
+
+		if (deadline > s->cycles) {
+			s->running = true;
+			s->cycles += z80_run(s->cpu, deadline - s->cycles);
+			s->running = false;
+		}
+
+		while (s->count && s->heap[0].cycle <= s->cycles) {
+			event due = pop(s);
+			due.handler(due.context, due.cycle);
+		}
+	}
+}
+
+void scheduler_stop(scheduler *s) {
+	s->stopped = true;
+	if (s->running) s->cpu->cycle_limit = s->cpu->cycles;
+}
@@ -0,0 +1,50 @@
+// Queue of device events keyed by absolute CPU cycle. The CPU runs until
+// the earliest one, so events happen at the exact cycle they are due.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "Z80.h"
+
+#define MAX_EVENTS 32
+
+typedef void (*event_handler)(void *context, uint64_t cycle);
+
+typedef struct {
+	uint64_t cycle;
+	event_handler handler;
+	void *context;
+} event;
+
+typedef struct {
+	Z80 *cpu;
+	uint64_t cycles;  // cycle at which the current or last z80_run started
+	bool running;
+	bool stopped;  // by scheduler_stop during the current scheduler_run
+	int count;
+	event heap[MAX_EVENTS];  // min-heap on cycle
+} scheduler;
+
+void scheduler_init(scheduler *s, Z80 *cpu);
+
+// Current cycle, also valid from the CPU callbacks during z80_run.
+uint64_t scheduler_now(const scheduler *s);
+
+// Returns false if the queue is full. Can be called from event handlers and
+// CPU callbacks; an event earlier than the current deadline shortens it.
+bool scheduler_add(scheduler *s, uint64_t cycle, event_handler handler, void *context);
+
+void scheduler_remove(scheduler *s, event_handler handler, void *context);
+
+// Runs the CPU and the events due until cycle `until` is reached, or until
+// scheduler_stop is called. The CPU may pass it by a few cycles; the excess
+// is subtracted from the next run.
+void scheduler_run(scheduler *s, uint64_t until);
+
+// Makes scheduler_run return at the next instruction boundary, after the
+// events due by then. Can be called from event handlers and CPU callbacks.
+void scheduler_stop(scheduler *s);
+
+#endif  // SCHEDULER_H
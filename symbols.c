@@ -0,0 +1,126 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "symbols.h"
+
+#define MAX_LINE_LEN 1024
+
+static bool parse_address(const char *token, uint16_t *address) {
+	char *end;
+	unsigned long value;
+	size_t len = strlen(token);
+
+	if (token[0] == '$' || token[0] == '#') {
+		value = strtoul(token + 1, &end, 16);
+		if (end == token + 1 || *end) return false;
+	} else if (token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+		value = strtoul(token + 2, &end, 16);
+		if (end == token + 2 || *end) return false;
+	} else if (len > 1 && (token[len - 1] == 'h' || token[len - 1] == 'H') && isdigit((unsigned char)token[0])) {
+		value = strtoul(token, &end, 16);
+		if (end != token + len - 1) return false;
+	} else if (len == 4) {
+		value = strtoul(token, &end, 16);
+		if (*end) return false;
+	} else {
+		return false;
+	}
+	if (value > 0xFFFF) return false;
+	*address = value;
+	return true;
+}
+
+static bool is_name(const char *token) {
+	if (!isalpha((unsigned char)*token) && !strchr("_.@?", *token)) return false;
+	for (const char *c = token; *c; c++) {
+		if (!isalnum((unsigned char)*c) && !strchr("_.@?$", *c)) return false;
+	}
+	return strcasecmp(token, "equ") && strcasecmp(token, "defl") && strcasecmp(token, "label");
+}
+
+bool symbols_is_local(const char *name) {
+	return strchr(name, '.') != NULL;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+	const symbol *x = a, *y = b;
+	if (x->address != y->address) return x->address < y->address ? -1 : 1;
+	// functions before the local labels at the same address
+	return symbols_is_local(x->name) - symbols_is_local(y->name);
+}
+
+bool symbols_load(symbol_table *t, const char *path) {
+	char line[MAX_LINE_LEN];
+	int capacity = t->count;
+	FILE *file = fopen(path, "r");
+	if (file == NULL) return false;
+
+	while (fgets(line, sizeof(line), file)) {
+		char *tokens[4];
+		int count = 0;
+		uint16_t address;
+		const char *name = NULL;
+
+		line[strcspn(line, ";\n")] = 0;
+		for (char *token = strtok(line, " \t\r:=,"); token && count < 4; token = strtok(NULL, " \t\r:=,")) {
+			tokens[count++] = token;
+		}
+		if (count < 2) continue;
+
+		if (is_name(tokens[0])) {
+			for (int i = 1; i < count && !name; i++) {
+				if (parse_address(tokens[i], &address)) name = tokens[0];
+			}
+		} else if (parse_address(tokens[0], &address) && is_name(tokens[1])) {
+			name = tokens[1];
+		}
+		if (name == NULL) continue;
+
+		if (t->count == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			t->symbols = realloc(t->symbols, capacity * sizeof(symbol));
+		}
+		t->symbols[t->count++] = (symbol){address, strdup(name)};
+	}
+	fclose(file);
+	qsort(t->symbols, t->count, sizeof(symbol), compare_symbols);
+	return true;
+}
+
+void symbols_free(symbol_table *t) {
+	for (int i = 0; i < t->count; i++) {
+		free(t->symbols[i].name);
+	}
+	free(t->symbols);
+	t->symbols = NULL;
+	t->count = 0;
+}
+
+int symbols_find(const symbol_table *t, uint16_t address, bool functions_only) {
+	int low = 0, high = t->count - 1, found = -1;
+	while (low <= high) {
+		int middle = (low + high) / 2;
+		if (t->symbols[middle].address <= address) {
+			found = middle;
+			low = middle + 1;
+		} else {
+			high = middle - 1;
+		}
+	}
+	while (functions_only && found >= 0 && symbols_is_local(t->symbols[found].name)) found--;
+	return found;
+}
+
+const char *symbols_name(const symbol_table *t, uint16_t address, char *buffer, int size) {
+	int found = symbols_find(t, address, true);
+	if (found < 0) {
+		snprintf(buffer, size, "$%.4X", address);
+	} else if (t->symbols[found].address == address) {
+		snprintf(buffer, size, "%s", t->symbols[found].name);
+	} else {
+		snprintf(buffer, size, "%s+%d", t->symbols[found].name, address - t->symbols[found].address);
+	}
+	return buffer;
+}
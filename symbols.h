@@ -0,0 +1,39 @@
+// Symbol table of a ROM, read from the symbol or map file of its assembler,
+// to name the addresses that the profilers report.
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+	uint16_t address;
+	char *name;
+} symbol;
+
+typedef struct {
+	symbol *symbols;  // sorted by address
+	int count;
+} symbol_table;
+
+// Adds the symbols of a file to the table, which must be zeroed or loaded.
+// Each line that has a name and an address is a symbol, in either order and
+// with or without EQU in between, which covers the symbol and map files of
+// the usual Z80 assemblers. Addresses can be written as 0x1234, $1234, 1234h,
+// or four hex digits. Names that contain a dot are local labels and do not
+// start a function.
+bool symbols_load(symbol_table *t, const char *path);
+void symbols_free(symbol_table *t);
+
+bool symbols_is_local(const char *name);
+
+// Index of the last symbol at or before the address, or -1. With
+// `functions_only`, local labels are skipped.
+int symbols_find(const symbol_table *t, uint16_t address, bool functions_only);
+
+// Writes the name of an address into `buffer`: the function that contains it,
+// with the offset if it is not the start, or $XXXX without symbols.
+const char *symbols_name(const symbol_table *t, uint16_t address, char *buffer, int size);
+
+#endif  // SYMBOLS_H
@@ -0,0 +1,245 @@
+// Reads a binary trace written by trace.c, prints it as text or writes the
+// records that pass the filters to a smaller trace.
+//
+//   trace-decode [-a FROM-TO] [-c FROM-TO] [-t TYPES] [-n COUNT] [-s] [-o OUTPUT] TRACE
+//
+//   -a  only instructions at PC FROM to TO (hex), with their accesses and
+//       registers, and interrupts whose handler is there
+//   -c  only records from cycle FROM to TO
+//   -t  record types to keep, any of: i (instructions), r (registers),
+//       m (memory), p (ports), n (interrupts); all by default
+//   -n  stop after COUNT instructions have been kept
+//   -s  print the number of records of each type kept instead of the records
+//   -o  write the records kept to OUTPUT as a trace instead of printing them
+//
+// The accesses of an instruction come before it in the trace and are printed
+// after it, indented like its registers. Instructions are printed with their
+// bytes and disassembly.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define CHUNK_RECORDS 65536
+#define MAX_PENDING 4096
+
+static const char *const type_names[] = {"instruction", "register", "int", "nmi", "read", "write", "in", "out"};
+static const char type_letters[] = "irnnmmpp";
+static const char *const register_names[] = {"AF", "BC", "DE", "HL", "IX", "IY", "SP", "AF'", "BC'", "DE'", "HL'"};
+
+typedef struct {
+	unsigned from_address, to_address;
+	unsigned long long from_cycle, to_cycle;
+	char types[16];
+	unsigned long long count;
+	bool summary;
+	FILE *output;
+
+	// state
+	bool in_range;  // of the last instruction, for the registers that follow
+	Z80TraceRecord pending[MAX_PENDING];  // accesses of the next instruction
+	int pending_count;
+	bool overflow;  // an instruction came after more accesses than fit
+	unsigned long long kept[8];
+	unsigned long long instructions;
+} filter;
+
+static bool keep_type(const filter *f, uint8_t type) {
+	return type < 8 && strchr(f->types, type_letters[type]);
+}
+
+static bool keep_cycle(const filter *f, uint64_t cycle) {
+	return cycle >= f->from_cycle && cycle <= f->to_cycle;
+}
+
+static bool keep_address(const filter *f, uint16_t address) {
+	return address >= f->from_address && address <= f->to_address;
+}
+
+static void print(const Z80TraceRecord *r) {
+	Z80Disassembly instruction;
+	char text[Z80_DISASSEMBLY_TEXT_SIZE];
+	printf("%12llu  ", (unsigned long long)r->cycle);
+	switch (r->type) {
+	case Z80_TRACE_INSTRUCTION:
+		z80_disassemble(r->address, r->data, &instruction);
+		z80_disassembly_format(&instruction, text);
+		printf("%.4X ", r->address);
+		for (int i = 0; i < 4; i++) printf(i < r->size && i < instruction.size ? " %.2X" : "   ", r->data[i]);
+		// An operand not fetched, like the offset of a JR not taken, is
+		// unknown; it is always the last one.
+		if (r->size < instruction.size && strrchr(text, '$')) strcpy(strrchr(text, '$'), "?");
+		printf("  %s", text);
+		break;
+	case Z80_TRACE_REGISTER:
+		if (r->address < Z80_TRACE_REGISTERS) {
+			printf("        %s=%.4X", register_names[r->address], r->data[0] | r->data[1] << 8);
+		} else {
+			printf("        register %d", r->address);
+		}
+		break;
+	case Z80_TRACE_INTERRUPT:
+		printf("%.4X  int im %d", r->address, r->data[0]);
+		break;
+	case Z80_TRACE_NMI:
+		printf("%.4X  nmi", r->address);
+		break;
+	case Z80_TRACE_READ:
+	case Z80_TRACE_WRITE:
+	case Z80_TRACE_IN:
+	case Z80_TRACE_OUT:
+		printf("        %-5s %.4X %.2X", type_names[r->type], r->address, r->data[0]);
+		break;
+	default:
+		printf("%.4X  unknown type %d", r->address, r->type);
+	}
+	putchar('\n');
+}
+
+static void emit(filter *f, const Z80TraceRecord *r) {
+	if (!keep_type(f, r->type) || !keep_cycle(f, r->cycle)) return;
+	f->kept[r->type]++;
+	if (f->summary) return;
+	if (f->output) fwrite(r, sizeof(*r), 1, f->output);
+	else print(r);
+}
+
+// Returns false once nothing more can be kept or the trace can not be read
+static bool process(filter *f, const Z80TraceRecord *r) {
+	switch (r->type) {
+	case Z80_TRACE_INSTRUCTION:
+		// instructions are in cycle order
+		if (r->cycle > f->to_cycle) return false;
+		f->in_range = keep_address(f, r->address);
+		if (f->in_range) {
+			// the accesses go after the instruction unless writing a trace
+			if (f->output) {
+				for (int i = 0; i < f->pending_count; i++) emit(f, &f->pending[i]);
+				emit(f, r);
+			} else {
+				emit(f, r);
+				for (int i = 0; i < f->pending_count; i++) emit(f, &f->pending[i]);
+			}
+			if (keep_type(f, r->type) && keep_cycle(f, r->cycle) && ++f->instructions == f->count) return false;
+		}
+		f->pending_count = 0;
+		return true;
+
+	case Z80_TRACE_REGISTER:
+		if (f->in_range) emit(f, r);
+		return true;
+
+	case Z80_TRACE_INTERRUPT:
+	case Z80_TRACE_NMI:
+		f->in_range = false;
+		if (keep_address(f, r->address)) emit(f, r);
+		return true;
+
+	default:
+		// every iteration of a repeated instruction has its own record, so
+		// no instruction comes close to the limit in a valid trace
+		if (f->pending_count == MAX_PENDING) {
+			f->overflow = true;
+			return false;
+		}
+		f->pending[f->pending_count++] = *r;
+		return true;
+	}
+}
+
+static bool parse_range(const char *text, int base, unsigned long long *from, unsigned long long *to) {
+	char *end;
+	*from = strtoull(text, &end, base);
+	if (end == text) return false;
+	if (*end == 0) {
+		*to = *from;
+		return true;
+	}
+	if (*end != '-') return false;
+	text = end + 1;
+	*to = *text ? strtoull(text, &end, base) : ~0ULL;
+	return *text == 0 || *end == 0;
+}
+
+int main(int argc, char *argv[]) {
+	static filter f = {.to_address = 0xFFFF, .to_cycle = ~0ULL, .types = "irmpn", .count = ~0ULL};
+	const char *output = NULL, *program = argv[0];
+	unsigned long long from, to;
+	int option;
+
+	while ((option = getopt(argc, argv, "a:c:t:n:so:")) != -1) {
+		switch (option) {
+		case 'a':
+			if (!parse_range(optarg, 16, &from, &to) || to > 0xFFFF) {
+				fprintf(stderr, "bad address range: %s\n", optarg);
+				return 2;
+			}
+			f.from_address = from;
+			f.to_address = to;
+			break;
+		case 'c':
+			if (!parse_range(optarg, 10, &f.from_cycle, &f.to_cycle)) {
+				fprintf(stderr, "bad cycle range: %s\n", optarg);
+				return 2;
+			}
+			break;
+		case 't': snprintf(f.types, sizeof(f.types), "%s", optarg); break;
+		case 'n': f.count = strtoull(optarg, NULL, 10); break;
+		case 's': f.summary = true; break;
+		case 'o': output = optarg; break;
+		default: return 2;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-a FROM-TO] [-c FROM-TO] [-t TYPES] [-n COUNT] [-s] [-o OUTPUT] TRACE\n", program);
+		return 2;
+	}
+
+	trace_header header;
+	FILE *file = fopen(argv[optind], "rb");
+	if (file == NULL) {
+		fprintf(stderr, "can not read %s: %s\n", argv[optind], strerror(errno));
+		return 2;
+	}
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic))
+		|| header.version != TRACE_VERSION || header.record_size != sizeof(Z80TraceRecord)) {
+		fprintf(stderr, "%s is not a trace of this version\n", argv[optind]);
+		return 2;
+	}
+	if (output) {
+		f.output = fopen(output, "wb");
+		if (f.output == NULL || fwrite(&header, sizeof(header), 1, f.output) != 1) {
+			fprintf(stderr, "can not write %s: %s\n", output, strerror(errno));
+			return 2;
+		}
+	}
+
+	Z80TraceRecord *records = malloc(CHUNK_RECORDS * sizeof(Z80TraceRecord));
+	size_t count;
+	bool more = true;
+	while (more && (count = fread(records, sizeof(Z80TraceRecord), CHUNK_RECORDS, file)) > 0) {
+		for (size_t i = 0; i < count && more; i++) {
+			more = process(&f, &records[i]);
+		}
+	}
+	free(records);
+	fclose(file);
+
+	if (f.overflow) {
+		fprintf(stderr, "%s has more than %d accesses before an instruction\n", argv[optind], MAX_PENDING);
+		return 2;
+	}
+
+	if (f.summary) {
+		for (int type = 0; type < 8; type++) {
+			printf("%-11s %llu\n", type_names[type], f.kept[type]);
+		}
+	}
+	if (f.output && fclose(f.output) != 0) {
+		fprintf(stderr, "can not write %s: %s\n", output, strerror(errno));
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#ifdef CPU_Z80_WITH_TRACE
+
+static Z80TraceRecord *buffer(tracer *t, int index) {
+	return t->ring + (size_t)index * TRACE_BUFFER_RECORDS;
+}
+
+static void *write_buffers(void *argument) {
+	tracer *t = argument;
+	pthread_mutex_lock(&t->lock);
+	for (;;) {
+		while (t->used[t->writing] == 0 && !t->stopping) {
+			pthread_cond_wait(&t->changed, &t->lock);
+		}
+		uint32_t used = t->used[t->writing];
+		if (used == 0) break;
+
+		// the CPU does not touch a full buffer, so it is written unlocked
+		pthread_mutex_unlock(&t->lock);
+		if (!t->failed && fwrite(buffer(t, t->writing), sizeof(Z80TraceRecord), used, t->file) != used) {
+			t->failed = true;
+		}
+		pthread_mutex_lock(&t->lock);
+
+		t->records += used;
+		t->used[t->writing] = 0;
+		t->writing = (t->writing + 1) % TRACE_BUFFERS;
+		pthread_cond_broadcast(&t->changed);
+	}
+	pthread_mutex_unlock(&t->lock);
+	return NULL;
+}
+
+// Hands the buffer being filled to the writer, with `used` records
+static void hand_over(tracer *t, uint32_t used) {
+	t->used[t->filling] = used;
+	t->filling = (t->filling + 1) % TRACE_BUFFERS;
+	pthread_cond_broadcast(&t->changed);
+}
+
+static void buffer_full(void *context) {
+	tracer *t = context;
+	pthread_mutex_lock(&t->lock);
+	hand_over(t, TRACE_BUFFER_RECORDS);
+	if (t->used[t->filling]) t->waits++;
+	while (t->used[t->filling]) {
+		pthread_cond_wait(&t->changed, &t->lock);
+	}
+	pthread_mutex_unlock(&t->lock);
+	t->cpu->trace = buffer(t, t->filling);
+	t->cpu->trace_end = t->cpu->trace + TRACE_BUFFER_RECORDS;
+}
+
+bool tracer_start(tracer *t, Z80 *cpu, const char *path, bool registers) {
+	trace_header header = {TRACE_MAGIC, TRACE_VERSION, sizeof(Z80TraceRecord)};
+
+	memset(t, 0, sizeof(*t));
+	t->ring = malloc((size_t)TRACE_BUFFERS * TRACE_BUFFER_RECORDS * sizeof(Z80TraceRecord));
+	if (t->ring == NULL) return false;
+	t->file = fopen(path, "wb");
+	if (t->file == NULL || fwrite(&header, sizeof(header), 1, t->file) != 1) {
+		if (t->file) fclose(t->file);
+		free(t->ring);
+		return false;
+	}
+	t->cpu = cpu;
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->changed, NULL);
+	int error = pthread_create(&t->writer, NULL, write_buffers, t);
+	if (error) {
+		pthread_mutex_destroy(&t->lock);
+		pthread_cond_destroy(&t->changed);
+		fclose(t->file);
+		free(t->ring);
+		errno = error;
+		return false;
+	}
+
+	memset(cpu->trace_values, 0, sizeof(cpu->trace_values));
+	cpu->trace_fetched_mask = 0;
+	cpu->trace_registers = registers;
+	cpu->trace_context = t;
+	cpu->trace_full = buffer_full;
+	cpu->trace_end = buffer(t, 0) + TRACE_BUFFER_RECORDS;
+	cpu->trace = buffer(t, 0);
+	return true;
+}
+
+bool tracer_stop(tracer *t) {
+	uint32_t used = t->cpu->trace - buffer(t, t->filling);
+	t->cpu->trace = NULL;
+
+	pthread_mutex_lock(&t->lock);
+	if (used) hand_over(t, used);
+	t->stopping = true;
+	pthread_cond_broadcast(&t->changed);
+	pthread_mutex_unlock(&t->lock);
+	pthread_join(t->writer, NULL);
+
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->changed);
+	free(t->ring);
+	bool failed = fclose(t->file) != 0 || t->failed;
+	return !failed;
+}
+
+#endif
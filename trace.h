@@ -0,0 +1,61 @@
+// Binary execution trace: the records that Z80.c writes when built with
+// CPU_Z80_WITH_TRACE go into a ring of buffers, and a writer thread saves the
+// full ones to a file while the CPU fills the next. The CPU only waits when
+// the writer falls a whole ring behind. See trace-decode.c for a reader.
+//
+// A trace file is a trace_header followed by Z80TraceRecords, in the byte
+// order of the host that wrote it.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "Z80.h"
+
+#define TRACE_MAGIC "Z80TRACE"
+#define TRACE_VERSION 2
+#define TRACE_BUFFERS 8
+#define TRACE_BUFFER_RECORDS 65536
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+} trace_header;
+
+#ifdef CPU_Z80_WITH_TRACE
+
+typedef struct {
+	Z80 *cpu;
+	FILE *file;
+	bool failed;  // a write failed; the rest of the trace is discarded
+
+	Z80TraceRecord *ring;  // TRACE_BUFFERS buffers of TRACE_BUFFER_RECORDS
+	uint32_t used[TRACE_BUFFERS];  // records of each full buffer, 0 if free
+	int filling;  // buffer the CPU is writing to
+	int writing;  // next buffer the writer saves
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	bool stopping;
+
+	uint64_t records;  // saved so far
+	uint64_t waits;    // times the CPU found the next buffer still full
+} tracer;
+
+// Starts tracing a CPU into a new file, with the register records if
+// `registers`. The cycles of the records count from the current trace_clock.
+// Returns false with errno set if the file can not be written or the writer
+// thread can not start.
+bool tracer_start(tracer *t, Z80 *cpu, const char *path, bool registers);
+
+// Stops tracing and saves the records left. Returns false if a write failed.
+bool tracer_stop(tracer *t);
+
+#endif
+
+#endif  // TRACE_H